@@ -0,0 +1,97 @@
+/*  The Clipboard Project - Cut, copy, and paste anything, anytime, anywhere, all from the terminal.
+    Copyright (C) 2023 Jackson Huff and other contributors on GitHub.com
+    SPDX-License-Identifier: GPL-3.0-or-later
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.*/
+#include "../src/clipboard.hpp"
+#include <iostream>
+#include <random>
+
+// Compares levenshteinDistance() against the plain matrix version it replaced, both for being right and for being fast.
+// Build it with -DBENCHMARKS=1 and run cb-benchmark-distance.
+
+static unsigned long matrixDistance(const std::string_view& one, const std::string_view& two) {
+    std::vector<std::vector<size_t>> matrix(one.size() + 1, std::vector<size_t>(two.size() + 1));
+    for (size_t i = 0; i <= one.size(); i++)
+        matrix[i][0] = i;
+    for (size_t j = 0; j <= two.size(); j++)
+        matrix[0][j] = j;
+    for (size_t i = 1; i <= one.size(); i++)
+        for (size_t j = 1; j <= two.size(); j++)
+            matrix[i][j] = one[i - 1] == two[j - 1] ? matrix[i - 1][j - 1] : std::min({matrix[i - 1][j - 1], matrix[i - 1][j], matrix[i][j - 1]}) + 1;
+    return matrix[one.size()][two.size()];
+}
+
+template <typename Function>
+static double nanosecondsPerCall(const std::vector<std::pair<std::string, std::string>>& pairs, const Function& function) {
+    volatile unsigned long sink = 0;
+    size_t calls = 0;
+    auto start = std::chrono::steady_clock::now();
+    do {
+        for (const auto& [one, two] : pairs)
+            sink = sink + function(one, two);
+        calls += pairs.size();
+    } while (std::chrono::steady_clock::now() - start < std::chrono::milliseconds(200));
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / calls;
+}
+
+int main() {
+    std::mt19937 random(1234);
+    auto randomString = [&](const size_t& length) {
+        std::string text(length, ' ');
+        for (auto& character : text)
+            character = "abcdefghijklmnopqrstuvwxyz ._-"[random() % 30];
+        return text;
+    };
+    auto edited = [&](std::string text, const size_t& edits) {
+        for (size_t edit = 0; edit < edits; edit++) {
+            auto where = text.empty() ? 0 : random() % text.size();
+            switch (random() % 3) {
+            case 0:
+                text.insert(where, 1, 'x');
+                break;
+            case 1:
+                if (!text.empty()) text.erase(where, 1);
+                break;
+            default:
+                if (!text.empty()) text[where] = 'y';
+            }
+        }
+        return text;
+    };
+
+    bool allCorrect = true;
+    printf("%8s %8s %14s %14s %14s %10s\n", "length", "limit", "matrix (ns)", "bits (ns)", "bits+limit", "speedup");
+    for (const auto& [length, limit] : std::vector<std::pair<size_t, unsigned long>> {{6, 2}, {30, 24}, {64, 24}, {200, 24}, {999, 24}}) {
+        std::vector<std::pair<std::string, std::string>> pairs;
+        for (int pair = 0; pair < 64; pair++) {
+            auto text = randomString(length);
+            // half of them are close and half are nowhere near, like in a real search
+            pairs.emplace_back(text, pair % 2 ? edited(text, random() % (limit + 4)) : randomString(length + random() % 8));
+        }
+        for (const auto& [one, two] : pairs) {
+            auto expected = matrixDistance(one, two);
+            auto exact = levenshteinDistance(one, two);
+            auto limited = levenshteinDistance(one, two, limit);
+            if (exact != expected || (expected <= limit ? limited != expected : limited <= limit)) {
+                fprintf(stderr, "Wrong distance for \"%s\" and \"%s\": expected %lu, got %lu and %lu with a limit of %lu\n", one.data(), two.data(), expected, exact, limited, limit);
+                allCorrect = false;
+            }
+        }
+        auto matrix = nanosecondsPerCall(pairs, matrixDistance);
+        auto bits = nanosecondsPerCall(pairs, [](const auto& one, const auto& two) { return levenshteinDistance(one, two); });
+        auto bitsWithLimit = nanosecondsPerCall(pairs, [&](const auto& one, const auto& two) { return levenshteinDistance(one, two, limit); });
+        printf("%8zu %8lu %14.1f %14.1f %14.1f %9.1fx\n", length, limit, matrix, bits, bitsWithLimit, matrix / bitsWithLimit);
+    }
+    return allCorrect ? EXIT_SUCCESS : EXIT_FAILURE;
+}
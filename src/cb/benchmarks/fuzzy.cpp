@@ -0,0 +1,131 @@
+/*  The Clipboard Project - Cut, copy, and paste anything, anytime, anywhere, all from the terminal.
+    Copyright (C) 2023 Jackson Huff and other contributors on GitHub.com
+    SPDX-License-Identifier: GPL-3.0-or-later
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.*/
+#include "../src/clipboard.hpp"
+#include <random>
+
+// Checks fuzzyMatch() against trying every way of picking out the query from short lines, and times it on content of all sizes.
+// Build it with -DBENCHMARKS=1 and run cb-benchmark-fuzzy.
+
+// The same scoring rules as fuzzy.cpp, applied to one given set of positions
+static int scoreOf(const std::string_view& content, const std::vector<size_t>& positions) {
+    auto classOf = [](const unsigned char& character) {
+        if ((character >= 'a' && character <= 'z') || character >= 0x80) return 3;
+        if (character >= 'A' && character <= 'Z') return 4;
+        if (character >= '0' && character <= '9') return 5;
+        if (character == ' ' || (character >= '\t' && character <= '\r')) return 0;
+        if (std::string_view("/,:;|_-.").find(character) != std::string_view::npos) return 1;
+        return 2;
+    };
+    auto bonusAt = [&](const size_t& position) {
+        auto previous = position == 0 ? 0 : classOf(content[position - 1]);
+        auto current = classOf(content[position]);
+        if (current > 2 && previous <= 2) return std::array {10, 9, 8}[previous];
+        if ((previous == 3 && current == 4) || (previous != 5 && current == 5)) return 7;
+        if (current == 0) return 10;
+        if (current <= 2) return 8;
+        return 0;
+    };
+    int score = 16 + bonusAt(positions[0]) * 2;
+    int chainBonus = bonusAt(positions[0]);
+    for (size_t i = 1; i < positions.size(); i++) {
+        if (positions[i] == positions[i - 1] + 1)
+            score += 16 + std::max({bonusAt(positions[i]), chainBonus, 4});
+        else {
+            chainBonus = bonusAt(positions[i]);
+            score += 16 + chainBonus - 3 - static_cast<int>(positions[i] - positions[i - 1] - 2);
+        }
+    }
+    return score;
+}
+
+static int bestPossible(const std::string_view& content, const std::string_view& query) {
+    int best = std::numeric_limits<int>::min();
+    std::vector<size_t> positions;
+    auto lowered = [](const char& character) { return static_cast<char>(std::tolower(static_cast<unsigned char>(character))); };
+    std::function<void(size_t)> pick = [&](const size_t& from) {
+        if (positions.size() == query.size()) {
+            best = std::max(best, scoreOf(content, positions));
+            return;
+        }
+        for (size_t position = from; position < content.size(); position++)
+            if (lowered(content[position]) == query[positions.size()]) {
+                positions.emplace_back(position);
+                pick(position + 1);
+                positions.pop_back();
+            }
+    };
+    pick(0);
+    return best;
+}
+
+template <typename Function>
+static double nanosecondsPerCall(const std::vector<std::string>& contents, const std::string& query, const Function& function) {
+    volatile unsigned long sink = 0;
+    size_t calls = 0;
+    auto start = std::chrono::steady_clock::now();
+    do {
+        for (const auto& content : contents)
+            sink = sink + function(content, query);
+        calls += contents.size();
+    } while (std::chrono::steady_clock::now() - start < std::chrono::milliseconds(200));
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / calls;
+}
+
+int main() {
+    std::mt19937 random(1234);
+    auto randomString = [&](const size_t& length) {
+        std::string text(length, ' ');
+        for (auto& character : text)
+            character = "abcdeABCDE01 ._-/"[random() % 17];
+        return text;
+    };
+
+    // the table keeps only the best way to reach each spot, like fzf does, so now and then it can miss a better run of bonuses
+    size_t checked = 0, inconsistent = 0, missedMatches = 0, suboptimal = 0;
+    for (int round = 0; round < 20000; round++) {
+        auto content = randomString(4 + random() % 14);
+        auto query = randomString(1 + random() % 4);
+        std::transform(query.begin(), query.end(), query.begin(), [](const auto& character) { return std::tolower(static_cast<unsigned char>(character)); });
+        auto expected = bestPossible(content, query);
+        auto match = fuzzyMatch(content, query);
+        checked++;
+        if (expected <= 0) continue; // the scorer leaves out matches that don't come out ahead
+        if (!match.has_value()) {
+            missedMatches++;
+            fprintf(stderr, "Missed \"%s\" in \"%s\"\n", query.data(), content.data());
+            continue;
+        }
+        auto score = scoreOf(content, match->positions);
+        auto perfect = static_cast<int>(query.size()) * 16 + 10 * (2 + static_cast<int>(query.size()) - 1);
+        if (static_cast<unsigned long>(std::min(1000, score * 1000 / perfect)) != match->score) inconsistent++;
+        if (score < expected) suboptimal++;
+    }
+    printf("%zu checked, %zu missed, %zu with positions that don't give their score, %zu below the best possible score\n", checked, missedMatches, inconsistent, suboptimal);
+
+    printf("%8s %8s %14s %10s\n", "length", "query", "fuzzy (ns)", "MB/s");
+    for (const auto& [length, query] : std::vector<std::pair<size_t, std::string>> {{30, "abc"}, {200, "abcde"}, {999, "ab.de"}, {64 * 1024, "a0b1c"}, {1024 * 1024, "a0b1c"}}) {
+        std::vector<std::string> contents;
+        for (int content = 0; content < (length > 100000 ? 2 : 32); content++) {
+            auto text = randomString(length);
+            for (size_t line = random() % 80; line < text.size(); line += 1 + random() % 160)
+                text[line] = '\n';
+            contents.emplace_back(std::move(text));
+        }
+        auto fuzzy = nanosecondsPerCall(contents, query, [](const auto& content, const auto& query) { return fuzzyMatch(content, query).value_or(FuzzyMatch {}).score; });
+        printf("%8zu %8s %14.1f %10.1f\n", length, query.data(), fuzzy, length * 1000.0 / fuzzy);
+    }
+    return missedMatches == 0 && inconsistent == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,71 @@
+/*  The Clipboard Project - Cut, copy, and paste anything, anytime, anywhere, all from the terminal.
+    Copyright (C) 2023 Jackson Huff and other contributors on GitHub.com
+    SPDX-License-Identifier: GPL-3.0-or-later
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.*/
+#include "../src/clipboard.hpp"
+#include <random>
+#include <regex>
+
+// Scans a synthetic history for a word the way search does, with findLiteral(), std::string_view::find() and std::regex_search().
+// Build it with -DBENCHMARKS=1 and run cb-benchmark-scan [MiB to scan, 1024 by default].
+
+int main(int argc, char** argv) {
+    size_t totalBytes = (argc > 1 ? std::stoul(argv[1]) : 1024) * 1024 * 1024;
+
+    // 64 MiB of entries of all sizes made of ordinary words, scanned over and over until the total is reached, which is close enough to a
+    // real history while not needing a whole gigabyte of memory
+    std::mt19937 random(1234);
+    std::vector<std::string_view> words {"the", "clipboard", "project", "copy", "paste", "foo", "bar", "hello", "world", "search", "history", "entry", "\n", "https://", "const", "auto"};
+    std::string history;
+    std::vector<std::string_view> entries;
+    std::vector<size_t> lengths;
+    while (history.size() < std::min<size_t>(totalBytes, 64 * 1024 * 1024)) {
+        size_t length = 16ul << (random() % 13); // 16 bytes up to 64 KiB
+        auto start = history.size();
+        while (history.size() - start < length)
+            history.append(words[random() % words.size()]).append(1, ' ');
+        lengths.emplace_back(history.size() - start);
+    }
+    for (size_t offset = 0, entry = 0; entry < lengths.size(); offset += lengths[entry++])
+        entries.emplace_back(history.data() + offset, lengths[entry]);
+    // one entry in a thousand has the word we're looking for
+    std::string_view needle = "needlework";
+    for (size_t entry = 0; entry < entries.size(); entry += 1000)
+        std::memcpy(const_cast<char*>(entries[entry].data()) + entries[entry].size() / 2 - needle.size() / 2, needle.data(), std::min(needle.size(), entries[entry].size()));
+
+    auto gigabytesPerSecond = [&](const auto& contains, const size_t& limit) {
+        size_t scanned = 0, found = 0;
+        auto start = std::chrono::steady_clock::now();
+        while (scanned < limit)
+            for (const auto& entry : entries) {
+                found += contains(entry);
+                scanned += entry.size();
+                if (scanned >= limit) break;
+            }
+        auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return std::make_pair(scanned / seconds / 1e9, found);
+    };
+
+    printf("Scanning %zu MiB in %zu entries for \"%s\" (findLiteral is using %s)\n", totalBytes / (1024 * 1024), entries.size(), needle.data(), literalScanner().data());
+    auto [literal, literalFound] = gigabytesPerSecond([&](const auto& entry) { return findLiteral(entry, needle) != std::string_view::npos; }, totalBytes);
+    printf("%-24s %8.2f GB/s %8zu found\n", "findLiteral", literal, literalFound);
+    auto [find, findFound] = gigabytesPerSecond([&](const auto& entry) { return entry.find(needle) != std::string_view::npos; }, totalBytes);
+    printf("%-24s %8.2f GB/s %8zu found\n", "std::string_view::find", find, findFound);
+    // regex is far too slow to go through all of it, so it only gets a taste
+    std::regex regex {std::string(needle), std::regex::ECMAScript | std::regex::optimize};
+    auto [regexSpeed, regexFound] = gigabytesPerSecond([&](const auto& entry) { return std::regex_search(entry.begin(), entry.end(), regex); }, totalBytes / 256);
+    printf("%-24s %8.2f GB/s %8zu found in 1/256 of it\n", "std::regex_search", regexSpeed, regexFound);
+    printf("findLiteral is %.1fx as fast as find and %.0fx as fast as regex\n", literal / find, literal / regexSpeed);
+    return literalFound == findFound ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -50,6 +50,7 @@ void clear() {
         fs::remove(path.metadata.originals);
         fs::remove(path.metadata.notes);
         fs::remove(path.metadata.ignore);
+        path.releaseUnusedObjects();
         stopIndicator();
         if (!output_silent && !confirmation_silent) fprintf(stderr, "%s", formatColors("[success][inverse] ✔ [noinverse] Cleared clipboard[blank]\n").data());
     }
@@ -58,6 +58,12 @@ void config() {
     // Remote clipboard integration
     fprintf(stderr, formatColors("[info]%s┃ Remote clipboard integration: [help]%s[blank]\n").data(), generatedEndbar().data(), envVarIsTrue("CLIPBOARD_NOREMOTE") ? "disabled" : "enabled");
 
+    // Compression
+    fprintf(stderr, formatColors("[info]%s┃ Content compression: [help]%s[blank]\n").data(), generatedEndbar().data(), path.compressesContent() ? "enabled" : "disabled");
+
+    // History packing
+    fprintf(stderr, formatColors("[info]%s┃ History packing: [help]%s[blank]\n").data(), generatedEndbar().data(), envVarIsTrue("CLIPBOARD_PACKHISTORY") ? "enabled" : "disabled");
+
     // Progress bar
     fprintf(stderr, formatColors("[info]%s┃ Progress bar: [help]%s[blank]\n").data(), generatedEndbar().data(), progress_silent ? "disabled" : "enabled");
 
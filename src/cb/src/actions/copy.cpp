@@ -17,14 +17,24 @@
 
 namespace PerformAction {
 
+static fs::path targetFor(const fs::path& f) {
+    if (fs::is_directory(f)) return f.filename().empty() ? f.parent_path().filename() : f.filename();
+    return f.filename();
+}
+
 void copyItem(const fs::path& f, const bool use_regular_copy) {
     auto actuallyCopyItem = [&] {
         if (fs::is_directory(f)) {
-            auto target = f.filename().empty() ? f.parent_path().filename() : f.filename();
+            auto target = targetFor(f);
+            unshareFile(path.data / target);
             fs::create_directories(path.data / target);
-            fs::copy(f, path.data / target, copying.opts);
+            copyPath(f, path.data / target);
         } else {
-            fs::copy(f, path.data / f.filename(), use_regular_copy ? copying.opts : copying.opts | fs::copy_options::create_hard_links);
+            unshareFile(path.data / f.filename());
+            if (use_regular_copy)
+                copyPath(f, path.data / f.filename());
+            else
+                fs::copy(f, path.data / f.filename(), copying.opts | fs::copy_options::create_hard_links);
         }
         incrementSuccessesForItem(f);
         if (action == Action::Cut) writeToFile(path.metadata.originals, fs::absolute(f).string() + "\n", true);
@@ -41,8 +51,34 @@ void copyItem(const fs::path& f, const bool use_regular_copy) {
 }
 
 void copy() {
-    for (const auto& f : copying.items)
-        copyItem(f);
+    if (!copying.use_safe_copy) {
+        for (const auto& f : copying.items)
+            copyItem(f);
+        return;
+    }
+
+    // start copying everything at once so that lots of small items or deep trees don't copy one file at a time
+    CopyEngine engine;
+    std::vector<fs::path> started;
+    for (const auto& f : copying.items) {
+        try {
+            unshareFile(path.data / targetFor(f));
+            engine.add(f, path.data / targetFor(f));
+            started.emplace_back(f);
+        } catch (const fs::filesystem_error& e) {
+            copying.failedItems.emplace_back(f.string(), e.code());
+        }
+    }
+
+    auto errors = engine.wait();
+    for (size_t i = 0; i < started.size(); i++) {
+        if (errors.at(i)) {
+            copying.failedItems.emplace_back(started.at(i).string(), errors.at(i));
+            continue;
+        }
+        incrementSuccessesForItem(started.at(i));
+        if (action == Action::Cut) writeToFile(path.metadata.originals, fs::absolute(started.at(i)).string() + "\n", true);
+    }
 }
 
 void copyText() {
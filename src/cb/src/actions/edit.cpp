@@ -30,6 +30,9 @@ void edit() {
 
     if (!editor) error_exit("%s", formatColors("[error][inverse] ✘ [noinverse] CB couldn't find a suitable editor to use. [help]⬤ Try setting the CLIPBOARD_EDITOR environment variable.[blank]\n"));
 
+    unshareFile(path.data.raw); // some editors write in place, which would change every entry sharing this content
+    decodeFile(path.data.raw, false); // the editor needs to see exactly what the content is
+
     // now run this editor with the text file as the argument
     auto command = editor.value() + " " + path.data.raw.string();
 
@@ -37,6 +40,8 @@ void edit() {
 
     int res = system(command.data());
 
+    escapeFile(path.data.raw);
+
     if (res != 0) error_exit("%s", formatColors("[error][inverse] ✘ [noinverse] CB couldn't open the editor. [help]⬤ Try setting the CLIPBOARD_EDITOR environment variable.[blank]\n"));
 }
 
@@ -42,8 +42,12 @@ void exportClipboards() {
             Clipboard clipboard(name);
             clipboard.getLock();
             if (clipboard.isUnused()) return;
-            fs::copy(clipboard, exportDirectory / name, copying.opts);
+            copyPath(clipboard, exportDirectory / name);
             fs::remove(exportDirectory / name / constants.metadata_directory / constants.lock_name);
+            // exported clipboards should be readable without CB, so undo any compression or chunking
+            for (const auto& entry : fs::directory_iterator(exportDirectory / name / constants.data_directory))
+                if (fs::exists(entry.path() / constants.data_file_name)) decodeFile(entry.path() / constants.data_file_name);
+            fs::remove_all(exportDirectory / name / constants.objects_directory / constants.chunks_directory);
             clipboard.releaseLock();
             successes.clipboards++;
         } catch (const fs::filesystem_error& e) {
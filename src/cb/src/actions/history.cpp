@@ -15,6 +15,8 @@
     along with this program.  If not, see <https://www.gnu.org/licenses/>.*/
 #include "../clipboard.hpp"
 #include <latch>
+#include <numeric>
+#include <queue>
 
 #if defined(_WIN32) || defined(_WIN64)
 #include <fcntl.h>
@@ -24,22 +26,12 @@
 #define STDERR_FILENO 2
 #endif
 
-#if defined(__linuxx__)
-#include <liburing.h>
-int SQEsSubmitted = 0;
-#endif
-
 #if defined(__linux__) || defined(__unix__) || defined(__APPLE__)
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #endif
 
-#if (defined(__linux__) || defined(__unix__) || defined(__APPLE__) || defined(__posix__)) && !defined(__OpenBSD__)
-#define USE_AIO 1
-#include <aio.h>
-#endif
-
 namespace PerformAction {
 
 void moveHistory() {
@@ -49,6 +41,7 @@ void moveHistory() {
         try {
             unsigned long entryNum = std::stoul(entry.string());
             absoluteEntryPaths.emplace_back(path.entryPathFor(entryNum));
+            path.unpackEntry(path.entryIndex.at(entryNum)); // only directories can be moved
         } catch (fs::filesystem_error& e) {
             copying.failedItems.emplace_back(entry.string(), e.code());
             continue;
@@ -57,6 +50,7 @@ void moveHistory() {
     for (const auto& entry : absoluteEntryPaths) {
         path.makeNewEntry();
         fs::rename(entry, path.data);
+        path.moveChunkReferences(std::stoul(entry.filename().string()), path.entryIndex.at(path.entry()));
         successful_entries++;
     }
     stopIndicator();
@@ -64,203 +58,223 @@ void moveHistory() {
     if (clipboard_name == constants.default_clipboard_name) updateExternalClipboards(true);
 }
 
-void history() {
-    if (!copying.items.empty()) {
-        moveHistory();
-        return;
-    }
-    std::vector<std::string> dates(path.entryIndex.size());
-
-    std::atomic<size_t> atomicLongestDateLength = 0;
+struct HistoryRow {
+    Clipboard* clipboard;
+    unsigned long entry;
+};
 
+static std::vector<HistoryRow> shownEntries(const size_t& limit) {
+    std::vector<unsigned long> entries;
     auto now = std::chrono::system_clock::now();
+    size_t skipped = 0;
+    if (since_option || until_option) {
+        // the time filters need every entry's record, so get them all at once
+        std::vector<unsigned long> everything(path.entryIndex.size());
+        std::iota(everything.begin(), everything.end(), 0);
+        path.prefetchEntryRecords(everything);
+    }
+    for (unsigned long entry = 0; entry < path.entryIndex.size(); entry++) {
+        if (limit > 0 && entries.size() >= limit) break; // newest first, so everything past here would be cut anyway
+        if (since_option || until_option) {
+            auto age = now - std::chrono::file_clock::to_sys(path.recordFor(entry).lastWriteTime());
+            // entries that were queued up again keep their old time, so an old entry doesn't mean the rest are old too
+            if (since_option && age > since_option.value()) continue;
+            if (until_option && age < until_option.value()) continue;
+        }
+        if (skipped < offset_option) {
+            skipped++;
+            continue;
+        }
+        entries.emplace_back(entry);
+    }
+    std::vector<HistoryRow> rows;
+    for (const auto& entry : entries)
+        rows.emplace_back(&path, entry);
+    return rows;
+}
 
-    auto totalThreads = suitableThreadAmount();
-    if (path.entryIndex.size() < totalThreads) totalThreads = path.entryIndex.size();
-
-    auto entriesPerThread = path.entryIndex.size() / totalThreads;
-
-    std::vector<std::thread> threads(totalThreads);
+static std::vector<HistoryRow> mergedEntries(std::vector<Clipboard>& clipboards, const size_t& limit) {
+    for (const auto& entry : fs::directory_iterator(global_path.temporary))
+        clipboards.emplace_back(entry.path().filename().string());
+    for (const auto& entry : fs::directory_iterator(global_path.persistent))
+        clipboards.emplace_back(entry.path().filename().string());
+    std::sort(clipboards.begin(), clipboards.end(), [](const auto& a, const auto& b) { return a.name() < b.name(); });
+
+    // every clipboard's history is already newest first, so repeatedly taking the newest of their next entries gives one timeline
+    // without looking at more than the entries shown plus one per clipboard
+    using Candidate = std::pair<int64_t, size_t>; // time of the clipboard's next entry, and which clipboard
+    std::priority_queue<Candidate> newest;
+    std::vector<unsigned long> next(clipboards.size(), 0);
+    for (size_t clipboard = 0; clipboard < clipboards.size(); clipboard++)
+        newest.emplace(clipboards[clipboard].recordFor(0).time, clipboard);
+
+    std::vector<HistoryRow> rows;
+    auto now = std::chrono::system_clock::now();
+    size_t skipped = 0;
+    while (!newest.empty() && (limit == 0 || rows.size() < limit)) {
+        auto [time, clipboard] = newest.top();
+        newest.pop();
+        auto entry = next[clipboard]++;
+        auto& cb = clipboards[clipboard];
+        if (next[clipboard] < cb.entryIndex.size()) newest.emplace(cb.recordFor(next[clipboard]).time, clipboard);
+
+        if (cb.recordFor(entry).content == EntryContent::Nothing) continue; // empty clipboards would only add noise here
+        auto age = now - std::chrono::file_clock::to_sys(fs::file_time_type(fs::file_time_type::duration(time)));
+        // entries that were queued up again keep their old time, so an old entry doesn't mean the rest are old too
+        if (since_option && age > since_option.value()) continue;
+        if (until_option && age < until_option.value()) continue;
+        if (skipped < offset_option) {
+            skipped++;
+            continue;
+        }
+        rows.emplace_back(&cb, entry);
+    }
+    return rows;
+}
 
-    auto dateWorker = [&](const unsigned long& start, const unsigned long& end) {
-        struct stat dateInfo;
-        std::string agoMessage;
-        agoMessage.reserve(16);
+// JSON output looks at records a screenful at a time, so the first lines show up right away no matter how long the history is
+static void prefetchRows(const std::vector<HistoryRow>& rows, const size_t& start, const size_t& end) {
+    std::vector<std::pair<Clipboard*, unsigned long>> wanted;
+    for (auto row = start; row < end; row++)
+        wanted.emplace_back(rows[row].clipboard, rows[row].entry);
+    prefetchEntryRecords(wanted);
+}
 
-        for (auto entry = start; entry < end; entry++) {
+static std::string timeAgo(const std::chrono::system_clock::duration& timeSince) {
 #if defined(__linux__) || defined(__APPLE__) || defined(__unix__)
-            stat(path.entryPathFor(entry).string().data(), &dateInfo);
-            auto timeSince = now - std::chrono::system_clock::from_time_t(dateInfo.st_mtime);
-            // format time like 1y 2d 3h 4m 5s
-            auto years = std::chrono::duration_cast<std::chrono::years>(timeSince);
-            auto days = std::chrono::duration_cast<std::chrono::days>(timeSince - years);
-            auto hours = std::chrono::duration_cast<std::chrono::hours>(timeSince - days);
-            auto minutes = std::chrono::duration_cast<std::chrono::minutes>(timeSince - days - hours);
-            auto seconds = std::chrono::duration_cast<std::chrono::seconds>(timeSince - days - hours - minutes);
-            if (years.count() > 0) agoMessage += std::to_string(years.count()) + "y ";
-            if (days.count() > 0) agoMessage += std::to_string(days.count()) + "d ";
-            if (hours.count() > 0) agoMessage += std::to_string(hours.count()) + "h ";
-            if (minutes.count() > 0) agoMessage += std::to_string(minutes.count()) + "m ";
-            agoMessage += std::to_string(seconds.count()) + "s";
-            dates[entry] = agoMessage;
-
-            if (agoMessage.length() > atomicLongestDateLength.load(std::memory_order_relaxed)) atomicLongestDateLength.store(agoMessage.length(), std::memory_order_relaxed);
-            agoMessage.clear();
+    // format time like 1y 2d 3h 4m 5s
+    std::string agoMessage;
+    auto years = std::chrono::duration_cast<std::chrono::years>(timeSince);
+    auto days = std::chrono::duration_cast<std::chrono::days>(timeSince - years);
+    auto hours = std::chrono::duration_cast<std::chrono::hours>(timeSince - days);
+    auto minutes = std::chrono::duration_cast<std::chrono::minutes>(timeSince - days - hours);
+    auto seconds = std::chrono::duration_cast<std::chrono::seconds>(timeSince - days - hours - minutes);
+    if (years.count() > 0) agoMessage += std::to_string(years.count()) + "y ";
+    if (days.count() > 0) agoMessage += std::to_string(days.count()) + "d ";
+    if (hours.count() > 0) agoMessage += std::to_string(hours.count()) + "h ";
+    if (minutes.count() > 0) agoMessage += std::to_string(minutes.count()) + "m ";
+    agoMessage += std::to_string(seconds.count()) + "s";
+    return agoMessage;
 #else
-            dates[entry] = "n/a";
-            atomicLongestDateLength.store(3, std::memory_order_relaxed);
+    return "n/a";
 #endif
-        }
-    };
+}
 
-    for (unsigned long thread = 0; thread < totalThreads; thread++) {
-        auto start = thread * entriesPerThread;
-        auto end = start + entriesPerThread;
-        if (thread == totalThreads - 1) end = path.entryIndex.size();
-        threads[thread] = std::thread(dateWorker, start, end);
+void history() {
+    if (!copying.items.empty()) {
+        moveHistory();
+        return;
     }
+    auto available = thisTerminalSize();
+    // the newest entries go at the bottom, so in the terminal only show as many as fit on the screen like searching does
+    size_t limit = limit_option > 0 ? limit_option : (is_tty.err ? (available.rows > 4 ? available.rows - 3 : 1) : 0);
+    std::vector<Clipboard> clipboards;
+    auto entries = all_option ? mergedEntries(clipboards, limit) : shownEntries(limit);
 
-    // for (auto& thread : threads)
-    //     thread.join();
-
-    // std::cout << "processing dates took " << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now() - now).count() << "ms" << std::endl;
-    // exit(0);
-
-#if defined(__linuxx__)
-    io_uring ring;
-    io_uring_queue_init(128, &ring, IORING_SETUP_SQPOLL);
-#endif
-
-#if defined(USE_AIO)
-    std::vector<std::shared_ptr<aiocb>> batchedAIOs;
-#endif
+    auto now = std::chrono::system_clock::now();
 
-#if defined(__linux__) || defined(USE_AIO)
-    constexpr size_t batchInterval = 1024 * 1024;
-#else
-    constexpr size_t batchInterval = 65536;
-#endif
+    unsigned long longestEntryLength = 1;
+    size_t longestClipboardLength = 0;
+    for (const auto& [clipboard, entry] : entries) {
+        longestEntryLength = std::max(longestEntryLength, numberLength(entry));
+        if (all_option) longestClipboardLength = std::max(longestClipboardLength, clipboard->name().length());
+    }
 
-    auto longestEntryLength = numberLength(path.entryIndex.size() - 1);
+    // the date column has to be as wide as the longest date before the first line goes out, so every shown entry's record is needed up front
+    prefetchRows(entries, 0, entries.size());
+    size_t longestDateLength = 0;
+    std::vector<std::string> dates;
+    for (const auto& [clipboard, entry] : entries) {
+        dates.emplace_back(timeAgo(now - std::chrono::file_clock::to_sys(clipboard->recordFor(entry).lastWriteTime())));
+        longestDateLength = std::max(longestDateLength, dates.back().length());
+    }
 
     stopIndicator();
-    auto available = thisTerminalSize();
     fprintf(stderr, "%s", formatColors("[info]┏━━[inverse] ").data());
     Message clipboard_history_message = "[bold]Entry history for clipboard [help] %s[nobold]";
-    fprintf(stderr, clipboard_history_message().data(), clipboard_name.data());
+    Message all_clipboards_history_message = "[bold]Entry history for all clipboards[nobold]";
+    size_t usedSpace;
+    if (all_option) {
+        fprintf(stderr, "%s", all_clipboards_history_message().data());
+        usedSpace = columnLength(all_clipboards_history_message) + 7;
+    } else {
+        fprintf(stderr, clipboard_history_message().data(), clipboard_name.data());
+        usedSpace = (columnLength(clipboard_history_message) - 2) + clipboard_name.length() + 7;
+    }
     fprintf(stderr, "%s", formatColors(" [noinverse][info]━").data());
-    auto usedSpace = (columnLength(clipboard_history_message) - 2) + clipboard_name.length() + 7;
     if (usedSpace > available.columns) available.columns = usedSpace;
     int columns = available.columns - usedSpace;
     fprintf(stderr, "%s%s", repeatString("━", columns).data(), formatColors("┓[blank]").data());
+    fflush(stderr);
 
+    size_t batchLines = std::max<size_t>(available.rows, 16);
     std::string batchedMessage;
-    // reserve enough contiguous memory for the entire batch, where the size is number of entries * line length, plus extra formatting characters
-    // this prevents reallocations and thus helps prevent invalidation of the data pointer
-    batchedMessage.reserve(path.entryIndex.size() * (available.columns + 64));
-    size_t offset = 0;
+    batchedMessage.reserve(batchLines * (available.columns + 64));
+    auto writeBatch = [&] {
+        for (size_t written = 0; written < batchedMessage.size();) {
+            auto result = write(STDERR_FILENO, batchedMessage.data() + written, batchedMessage.size() - written);
+            if (result <= 0) break;
+            written += result;
+        }
+        batchedMessage.clear();
+    };
 
     const std::array preformattedMessageParts = {
             formatColors("\n[info]\033[" + std::to_string(available.columns) + "G┃\r┃ [bold]"),
             formatColors("[nobold]│ [bold]"),
             formatColors("[nobold]│[help] ")};
 
-    for (auto& thread : threads)
-        thread.join();
-
-    size_t longestDateLength = atomicLongestDateLength.load(std::memory_order_relaxed);
-
-    for (long entry = path.entryIndex.size() - 1; entry >= 0; entry--) {
-        path.setEntry(entry);
+    for (size_t batchEnd = entries.size(); batchEnd > 0;) {
+        size_t batchStart = batchEnd - std::min(batchEnd, batchLines);
+        for (auto shown = batchEnd; shown-- > batchStart;) {
+            auto [clipboard, entry] = entries[shown];
+            const auto& record = clipboard->recordFor(entry);
+            const auto& date = dates.at(shown);
 
-        if (batchedMessage.size() - offset > batchInterval) {
-#if defined(__linuxx__)
-            auto sqe = io_uring_get_sqe(&ring);
-            auto rawByteAtOffset = batchedMessage.data() + offset;
-            io_uring_prep_write(sqe, STDERR_FILENO, rawByteAtOffset, batchedMessage.size() - offset, 0);
+            int widthRemaining = available.columns - (numberLength(entry) + longestEntryLength + longestDateLength + 7);
 
-            SQEsSubmitted += io_uring_submit(&ring);
-            offset = batchedMessage.size();
-#elif defined(USE_AIO)
-            auto aio = std::make_shared<aiocb>();
-            auto rawByteAtOffset = batchedMessage.data() + offset;
-            aio->aio_fildes = STDERR_FILENO;
-            aio->aio_buf = static_cast<void*>(rawByteAtOffset);
-            aio->aio_nbytes = batchedMessage.size() - offset;
-            aio_write(aio.get());
-
-            offset = batchedMessage.size();
-            batchedAIOs.emplace_back(aio);
-#else
-            auto ret = write(STDERR_FILENO, batchedMessage.data(), batchedMessage.size());
-            batchedMessage.clear();
-#endif
-        }
-
-        int widthRemaining = available.columns - (numberLength(entry) + longestEntryLength + longestDateLength + 7);
-
-        batchedMessage += preformattedMessageParts[0] + std::string(longestEntryLength - numberLength(entry), ' ') + std::to_string(entry) + preformattedMessageParts[1]
-                          + std::string(longestDateLength - dates.at(entry).length(), ' ') + dates.at(entry) + preformattedMessageParts[2];
-
-        if (auto temp(fileContents(path.data.raw)); temp.has_value()) {
-            auto content = std::move(temp.value());
-            if (content.empty()) continue; // don't use holdsRawDataInCurrentEntry because we are reading anyway, so we can save on a syscall
-            if (auto MIMEtype = inferMIMEType(content); MIMEtype.has_value())
-                content = "\033[7m\033[1m " + std::string(MIMEtype.value()) + ", " + formatBytes(content.length()) + " \033[22m\033[27m";
-            else
-                content = makeControlCharactersVisible(content, available.columns);
-            batchedMessage += content.substr(0, widthRemaining);
-            continue;
-        }
+            batchedMessage += preformattedMessageParts[0];
+            if (all_option) {
+                batchedMessage += std::string(longestClipboardLength - clipboard->name().length(), ' ') + clipboard->name() + preformattedMessageParts[1];
+                widthRemaining -= longestClipboardLength + 2;
+            }
+            batchedMessage += std::string(longestEntryLength - numberLength(entry), ' ') + std::to_string(entry) + preformattedMessageParts[1]
+                              + std::string(longestDateLength - date.length(), ' ') + date + preformattedMessageParts[2];
 
-        for (bool first = true; const auto& entry : fs::directory_iterator(path.data)) {
-            auto filename = entry.path().filename().string();
-            if (filename == constants.data_file_name && entry.file_size() == 0) continue;
+            if (record.content == EntryContent::RawData) {
+                std::string content;
+                if (auto MIMEtype = record.mimeType(); !MIMEtype.empty())
+                    content = "\033[7m\033[1m " + std::string(MIMEtype) + ", " + formatBytes(record.bytes) + " \033[22m\033[27m";
+                else
+                    content = makeControlCharactersVisible(std::string(record.previewText()), available.columns);
+                batchedMessage += content.substr(0, widthRemaining);
+                continue;
+            }
 
-            if (widthRemaining <= 0) break;
+            for (bool first = true; const auto& [filename, isDirectory] : record.itemNames()) {
+                if (widthRemaining <= 0) break;
 
-            if (!first) {
-                if (filename.length() <= widthRemaining - 2) {
-                    batchedMessage += ", ";
-                    widthRemaining -= 2;
+                if (!first) {
+                    if (filename.length() <= widthRemaining - 2) {
+                        batchedMessage += ", ";
+                        widthRemaining -= 2;
+                    }
                 }
-            }
 
-            if (filename.length() <= widthRemaining) {
-                if (entry.is_directory())
-                    batchedMessage += "\033[4m" + filename + "\033[24m";
-                else
-                    batchedMessage += "\033[1m" + filename + "\033[22m";
-                widthRemaining -= filename.length();
-                first = false;
+                if (filename.length() <= widthRemaining) {
+                    if (isDirectory)
+                        batchedMessage += "\033[4m" + std::string(filename) + "\033[24m";
+                    else
+                        batchedMessage += "\033[1m" + std::string(filename) + "\033[22m";
+                    widthRemaining -= filename.length();
+                    first = false;
+                }
             }
         }
-    }
 
-#if defined(__linuxx__)
-    auto sqe = io_uring_get_sqe(&ring);
-    auto rawByteAtOffset = batchedMessage.data() + offset;
-    io_uring_prep_write(sqe, STDERR_FILENO, rawByteAtOffset, batchedMessage.size() - offset, 0);
-
-    // block until all writes are done
-    io_uring_submit_and_wait(&ring, SQEsSubmitted + 1);
-    io_uring_queue_exit(&ring);
-#elif defined(USE_AIO)
-    auto rawByteAtOffset = batchedMessage.data() + offset;
-    auto aio = std::make_shared<aiocb>();
-    aio->aio_fildes = STDERR_FILENO;
-    aio->aio_buf = static_cast<void*>(rawByteAtOffset);
-    aio->aio_nbytes = batchedMessage.size() - offset;
-    aio_write(aio.get());
-    batchedAIOs.emplace_back(aio);
-
-    for (const auto& aio : batchedAIOs) {
-        const std::array<const aiocb*, 1> aio_list = {aio.get()};
-        aio_suspend(aio_list.data(), aio_list.size(), nullptr);
+        writeBatch();
+        batchEnd = batchStart;
     }
-#else
-    auto ret = write(STDERR_FILENO, batchedMessage.data(), batchedMessage.size());
-#endif
 
     fputs(formatColors("[info]\n┗━━▌").data(), stderr);
     Message status_legend_message = "[help]Text, \033[1mFiles\033[22m, \033[4mDirectories\033[24m, \033[7m\033[1m Data \033[22m\033[27m[info]";
@@ -270,29 +284,47 @@ void history() {
     std::string bar2 = "▐" + repeatString("━", cols);
     fputs((status_legend_message() + bar2).data(), stderr);
     fputs(formatColors("┛[blank]\n").data(), stderr);
+    for (auto& clipboard : clipboards)
+        clipboard.saveEntryIndex();
 }
 
 void historyJSON() {
-    printf("{\n");
-    for (unsigned long entry = 0; entry < path.entryIndex.size(); entry++) {
-        path.setEntry(entry);
-        printf("    \"%lu\": {\n", entry);
-        printf("        \"date\": %zu,\n", static_cast<size_t>(fs::last_write_time(path.data).time_since_epoch().count()));
+    std::vector<Clipboard> clipboards;
+    auto entries = all_option ? mergedEntries(clipboards, limit_option) : shownEntries(limit_option);
+    // one clipboard's entries are keyed by entry number, but a timeline across clipboards needs its order kept, so it's a list
+    printf(all_option ? "[\n" : "{\n");
+    size_t batchLines = std::max<size_t>(thisTerminalSize().rows, 16);
+    for (size_t shown = 0; shown < entries.size(); shown++) {
+        if (shown % batchLines == 0) {
+            fflush(stdout);
+            prefetchRows(entries, shown, std::min(shown + batchLines, entries.size()));
+        }
+        const auto& [clipboard, entry] = entries[shown];
+        const auto& record = clipboard->recordFor(entry);
+        if (all_option) {
+            printf("    {\n");
+            printf("        \"clipboard\": \"%s\",\n", JSONescape(clipboard->name()).data());
+            printf("        \"entry\": %lu,\n", entry);
+        } else
+            printf("    \"%lu\": {\n", entry);
+        printf("        \"date\": %zu,\n", static_cast<size_t>(record.time));
         printf("        \"content\": ");
-        if (path.holdsRawDataInCurrentEntry()) {
-            std::string content(fileContents(path.data.raw).value());
-            if (auto type = inferMIMEType(content); type.has_value()) {
+        if (record.content == EntryContent::RawData) {
+            if (auto type = record.mimeType(); !type.empty()) {
                 printf("{\n");
-                printf("            \"dataType\": \"%s\",\n", type.value().data());
-                printf("            \"dataSize\": %zd,\n", content.length());
-                printf("            \"path\": \"%s\"\n", JSONescape(path.data.raw.string()).data());
+                printf("            \"dataType\": \"%s\",\n", std::string(type).data());
+                printf("            \"dataSize\": %zd,\n", static_cast<size_t>(record.bytes));
+                if (clipboard->isPacked(entry))
+                    printf("            \"path\": null\n"); // packed content isn't in a file of its own
+                else
+                    printf("            \"path\": \"%s\"\n", JSONescape((clipboard->entryPathFor(entry) / constants.data_file_name).string()).data());
                 printf("        }");
             } else {
-                printf("\"%s\"", JSONescape(content).data());
+                printf("\"%s\"", JSONescape(clipboard->rawDataFor(entry).content()).data());
             }
-        } else if (path.holdsDataInCurrentEntry()) {
+        } else if (record.content == EntryContent::Items) {
             printf("[\n");
-            std::vector<fs::path> itemsInPath(fs::directory_iterator(path.data), fs::directory_iterator());
+            std::vector<fs::path> itemsInPath(fs::directory_iterator(clipboard->entryPathFor(entry)), fs::directory_iterator());
             for (const auto& entry : itemsInPath) {
                 printf("            {\n");
                 printf("                \"filename\": \"%s\",\n", JSONescape(entry.filename().string()).data());
@@ -304,9 +336,11 @@ void historyJSON() {
         } else {
             printf("null");
         }
-        printf("\n    }%s\n", entry == path.entryIndex.size() - 1 ? "" : ",");
+        printf("\n    }%s\n", shown == entries.size() - 1 ? "" : ",");
     }
-    printf("}\n");
+    printf(all_option ? "]\n" : "}\n");
+    for (auto& clipboard : clipboards)
+        clipboard.saveEntryIndex();
 }
 
 } // namespace PerformAction
@@ -42,7 +42,8 @@ void importClipboards() {
                     case SkipAll:
                         continue;
                     case ReplaceAll:
-                        fs::copy(entry.path(), target, fs::copy_options::recursive | fs::copy_options::overwrite_existing);
+                        unshareFile(target); // copies write over existing files in place, and this clipboard's entries share content
+                        copyPath(entry.path(), target, fs::copy_options::recursive | fs::copy_options::overwrite_existing);
                         successes.clipboards++;
                         break;
                     default:
@@ -50,13 +51,14 @@ void importClipboards() {
                         copying.policy = userDecision(entry.path().filename().string());
                         startIndicator();
                         if (copying.policy == ReplaceOnce || copying.policy == ReplaceAll) {
-                            fs::copy(entry.path(), target, fs::copy_options::recursive | fs::copy_options::overwrite_existing);
+                            unshareFile(target);
+                            copyPath(entry.path(), target, fs::copy_options::recursive | fs::copy_options::overwrite_existing);
                             successes.clipboards++;
                         }
                         break;
                     }
                 } else {
-                    fs::copy(entry.path(), target, fs::copy_options::recursive);
+                    copyPath(entry.path(), target, fs::copy_options::recursive);
                     successes.clipboards++;
                 }
             } catch (const fs::filesystem_error& e) {
@@ -29,6 +29,20 @@
 
 namespace PerformAction {
 
+#if defined(__linux__) || defined(__APPLE__) || defined(__unix__) || defined(__FreeBSD__)
+static time_t contentLastChanged() {
+    if (path.isPacked(path.entry())) // packed entries don't have a directory, but they never change either
+        return std::chrono::system_clock::to_time_t(std::chrono::time_point_cast<std::chrono::system_clock::duration>(std::chrono::file_clock::to_sys(path.recordFor(path.entry()).lastWriteTime())));
+    time_t latest = 0;
+    for (const auto& entry : fs::recursive_directory_iterator(path.data)) {
+        struct stat info;
+        stat(entry.path().string().data(), &info);
+        if (info.st_ctime > latest) latest = info.st_ctime;
+    }
+    return latest;
+}
+#endif
+
 void info() {
     stopIndicator();
     fprintf(stderr, "%s", formatColors("[info]┏━━[inverse] ").data());
@@ -51,12 +65,7 @@ void info() {
 #endif
 
 #if defined(__linux__) || defined(__APPLE__) || defined(__unix__) || defined(__FreeBSD__)
-    time_t latest = 0;
-    for (const auto& entry : fs::recursive_directory_iterator(path.data)) {
-        struct stat info;
-        stat(entry.path().string().data(), &info);
-        if (info.st_ctime > latest) latest = info.st_ctime;
-    }
+    time_t latest = contentLastChanged();
     time = std::ctime(&latest);
     std::erase(time, '\n');
     fprintf(stderr, formatColors("[info]%s┃ Content last changed [help]%s[blank]\n").data(), generatedEndbar().data(), time.data());
@@ -78,18 +87,18 @@ void info() {
     fprintf(stderr, formatColors("[info]%s┃ Total clipboard size: [help]%s[blank]\n").data(), generatedEndbar().data(), formatBytes(totalDirectorySize(path)).data());
     fprintf(stderr, formatColors("[info]%s┃ Total space remaining: [help]%s[blank]\n").data(), generatedEndbar().data(), formatBytes(fs::space(path).available).data());
 
-    if (path.holdsRawDataInCurrentEntry()) {
-        fprintf(stderr, formatColors("[info]%s┃ Content size: [help]%s[blank]\n").data(), generatedEndbar().data(), formatBytes(fs::file_size(path.data.raw)).data());
-        fprintf(stderr, formatColors("[info]%s┃ Content type: [help]%s[blank]\n").data(), generatedEndbar().data(), inferMIMEType(fileContents(path.data.raw).value()).value_or("text/plain").data());
+    path.prefetchEntryRecords({path.entry()});
+    const auto& record = path.freshRecordFor(path.entry());
+    if (record.content == EntryContent::RawData) {
+        fprintf(stderr, formatColors("[info]%s┃ Content size: [help]%s[blank]\n").data(), generatedEndbar().data(), formatBytes(record.bytes).data());
+        auto type = record.mimeType();
+        fprintf(stderr, formatColors("[info]%s┃ Content type: [help]%s[blank]\n").data(), generatedEndbar().data(), type.empty() ? "text/plain" : std::string(type).data());
     } else {
-        size_t files = 0;
-        size_t directories = 0;
-        fprintf(stderr, formatColors("[info]%s┃ Content size: [help]%s[blank]\n").data(), generatedEndbar().data(), formatBytes(totalDirectorySize(path.data)).data());
-        for (const auto& entry : fs::directory_iterator(path.data))
-            entry.is_directory() ? directories++ : files++;
-        fprintf(stderr, formatColors("[info]%s┃ Files: [help]%zu[blank]\n").data(), generatedEndbar().data(), files);
-        fprintf(stderr, formatColors("[info]%s┃ Directories: [help]%zu[blank]\n").data(), generatedEndbar().data(), directories);
+        fprintf(stderr, formatColors("[info]%s┃ Content size: [help]%s[blank]\n").data(), generatedEndbar().data(), formatBytes(record.bytes).data());
+        fprintf(stderr, formatColors("[info]%s┃ Files: [help]%zu[blank]\n").data(), generatedEndbar().data(), static_cast<size_t>(record.files));
+        fprintf(stderr, formatColors("[info]%s┃ Directories: [help]%zu[blank]\n").data(), generatedEndbar().data(), static_cast<size_t>(record.directories));
     }
+    if (record.hashed) fprintf(stderr, formatColors("[info]%s┃ Content hash (SHA-256): [help]%s[blank]\n").data(), generatedEndbar().data(), record.hashText().data());
 
     if (!available_mimes.empty()) {
         fprintf(stderr, formatColors("[info]%s┃ Available types from GUI: [help]").data(), generatedEndbar().data());
@@ -146,12 +155,7 @@ void infoJSON() {
 #endif
 
 #if defined(__linux__) || defined(__APPLE__) || defined(__unix__)
-    time_t latest = 0;
-    for (const auto& entry : fs::recursive_directory_iterator(path.data)) {
-        struct stat info;
-        stat(entry.path().string().data(), &info);
-        if (info.st_ctime > latest) latest = info.st_ctime;
-    }
+    time_t latest = contentLastChanged();
     time = std::ctime(&latest);
     std::erase(time, '\n');
     printf("    \"contentLastChanged\": \"%s\",\n", time.data());
@@ -173,18 +177,18 @@ void infoJSON() {
     printf("    \"totalBytesUsed\": %zu,\n", totalDirectorySize(path));
     printf("    \"totalBytesRemaining\": %zu,\n", fs::space(path).available);
 
-    if (path.holdsRawDataInCurrentEntry()) {
-        printf("    \"contentBytes\": %zu,\n", fs::file_size(path.data.raw));
-        printf("    \"contentType\": \"%s\",\n", inferMIMEType(fileContents(path.data.raw).value()).value_or("text/plain").data());
+    path.prefetchEntryRecords({path.entry()});
+    const auto& record = path.freshRecordFor(path.entry());
+    if (record.content == EntryContent::RawData) {
+        auto type = record.mimeType();
+        printf("    \"contentBytes\": %zu,\n", static_cast<size_t>(record.bytes));
+        printf("    \"contentType\": \"%s\",\n", type.empty() ? "text/plain" : std::string(type).data());
     } else {
-        size_t files = 0;
-        size_t directories = 0;
-        for (const auto& entry : fs::directory_iterator(path.data))
-            entry.is_directory() ? directories++ : files++;
-        printf("    \"contentBytes\": %zu,\n", totalDirectorySize(path.data));
-        printf("    \"files\": %zu,\n", files);
-        printf("    \"directories\": %zu,\n", directories);
+        printf("    \"contentBytes\": %zu,\n", static_cast<size_t>(record.bytes));
+        printf("    \"files\": %zu,\n", static_cast<size_t>(record.files));
+        printf("    \"directories\": %zu,\n", static_cast<size_t>(record.directories));
     }
+    if (record.hashed) printf("    \"sha256\": \"%s\",\n", record.hashText().data());
 
     if (!available_mimes.empty()) {
         printf("    \"availableTypes\": [");
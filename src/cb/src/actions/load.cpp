@@ -14,6 +14,7 @@
     You should have received a copy of the GNU General Public License
     along with this program.  If not, see <https://www.gnu.org/licenses/>.*/
 #include "../clipboard.hpp"
+#include <fstream>
 
 namespace PerformAction {
 
@@ -37,24 +38,45 @@ void load() {
     for (const auto& destination_number : destinations) {
         Clipboard destination(destination_number);
         try {
+            CopyEngine engine;
+            std::vector<fs::path> started;
             for (const auto& entry : fs::directory_iterator(path.data)) {
                 auto target = destination.data / entry.path().filename();
-                auto loadItem = [&](bool use_regular_copy = copying.use_safe_copy) {
-                    if (entry.is_directory())
-                        fs::copy(entry.path(), target, copying.opts);
-                    else
-                        fs::copy(entry.path(), target, use_regular_copy ? copying.opts : (copying.opts | fs::copy_options::create_hard_links));
-                };
-                try {
-                    loadItem();
-                } catch (const fs::filesystem_error& e) {
-                    if (!copying.use_safe_copy && e.code() == std::errc::cross_device_link) loadItem(true);
+                if (entry.path().filename() == constants.data_file_name && isEncodedFile(entry)) { // chunks are only stored in the source clipboard
+                    // the target might be a hard link to content other entries share, so replace it instead of writing through it
+                    auto temporary = target;
+                    temporary += ".loading";
+                    std::ofstream output(temporary, std::ios::binary | std::ios::trunc);
+                    streamFileContents(entry, [&](const std::string_view& content) { return static_cast<bool>(output.write(content.data(), content.size())); });
+                    output.close();
+                    escapeFile(temporary);
+                    fs::rename(temporary, target);
+                } else {
+                    unshareFile(target); // the destination deduplicates its entries, so an existing target might share its content too
+                    engine.add(entry.path(), target); // hard links would tie the destination's content to the source's objects, so always copy
+                    started.emplace_back(entry.path());
                 }
             }
+            bool loadedEverything = true;
+            auto errors = engine.wait();
+            for (size_t i = 0; i < started.size(); i++)
+                if (errors.at(i)) {
+                    copying.failedItems.emplace_back(started.at(i).filename().string(), errors.at(i));
+                    loadedEverything = false;
+                }
 
             destination.applyIgnoreRules();
 
-            successes.clipboards++;
+            destination.chunkCurrentEntry();
+
+            destination.compressCurrentEntry();
+
+            destination.deduplicateCurrentEntry();
+
+            destination.updateEntryRecord();
+            destination.saveEntryIndex();
+
+            if (loadedEverything) successes.clipboards++;
         } catch (const fs::filesystem_error& e) {
             copying.failedItems.emplace_back(destination_number, e.code());
         }
@@ -14,6 +14,7 @@
     You should have received a copy of the GNU General Public License
     along with this program.  If not, see <https://www.gnu.org/licenses/>.*/
 #include "../clipboard.hpp"
+#include <fstream>
 
 namespace PerformAction {
 
@@ -27,17 +28,37 @@ void paste() {
         std::transform(splitted.begin(), splitted.end(), std::back_inserter(regexes), [](const auto& item) { return std::regex(item); });
     }
 
-    for (const auto& entry : fs::directory_iterator(path.data)) {
+    bool packed = path.isPacked(path.entry());
+    std::vector<fs::directory_entry> entries;
+    if (packed)
+        entries.emplace_back(path.data.raw); // packed entries only ever hold raw data, which gets read right from the pack
+    else
+        entries.assign(fs::directory_iterator(path.data), fs::directory_iterator());
+
+    CopyEngine engine;
+    std::vector<fs::directory_entry> started;
+    for (const auto& entry : entries) {
         auto target = [&] {
-            if (path.holdsRawDataInCurrentEntry())
-                return (fs::current_path() / ("clipboard" + clipboard_name + "-" + std::to_string(clipboard_entry)))
-                        .replace_extension(inferFileExtension(fileContents(path.data.raw).value()).value_or(".txt"));
-            else
-                return fs::current_path() / entry.path().filename();
+            if (path.holdsRawDataInCurrentEntry()) {
+                auto head = packed ? std::string(path.rawDataFor(path.entry()).content().substr(0, constants.preview_head_size)) : fileHead(path.data.raw, constants.preview_head_size);
+                return (fs::current_path() / ("clipboard" + clipboard_name + "-" + std::to_string(clipboard_entry))).replace_extension(inferFileExtension(head).value_or(".txt"));
+            }
+            return fs::current_path() / entry.path().filename();
         }();
         auto pasteItem = [&](const bool use_regular_copy = copying.use_safe_copy) {
             if (!(fs::exists(target) && fs::equivalent(entry, target))) {
-                fs::copy(entry, target, use_regular_copy || entry.is_directory() ? copying.opts : copying.opts | fs::copy_options::create_hard_links);
+                if (packed) {
+                    auto content = path.rawDataFor(path.entry());
+                    std::ofstream(target, std::ios::binary | std::ios::trunc).write(content.data(), content.size());
+                } else if (entry.path().filename() == constants.data_file_name && isEncodedFile(entry)) {
+                    std::ofstream output(target, std::ios::binary | std::ios::trunc);
+                    streamFileContents(entry, [&](const std::string_view& content) { return static_cast<bool>(output.write(content.data(), content.size())); });
+                } else if (use_regular_copy || entry.is_directory()) {
+                    engine.add(entry, target);
+                    started.emplace_back(entry);
+                    return; // this counts as a success once the engine is done with it
+                } else
+                    fs::copy(entry, target, copying.opts | fs::copy_options::create_hard_links);
             }
             incrementSuccessesForItem(entry);
         };
@@ -78,6 +99,14 @@ void paste() {
             }
         }
     }
+
+    auto errors = engine.wait();
+    for (size_t i = 0; i < started.size(); i++) {
+        if (errors.at(i))
+            copying.failedItems.emplace_back(started.at(i).path().filename().string(), errors.at(i));
+        else
+            incrementSuccessesForItem(started.at(i));
+    }
     removeOldFiles();
 }
 
@@ -18,30 +18,117 @@
 #if defined(_WIN32) || defined(_WIN64)
 #include <fcntl.h>
 #include <format>
+#include <fstream>
 #include <io.h>
 #endif
 
+#if defined(__linux__)
+#include <sys/sendfile.h>
+#endif
+
+#include <csignal>
+
 namespace PerformAction {
 
 void pipeIn() {
-    copying.buffer = pipedInContent();
-    writeToFile(path.data.raw, copying.buffer);
+    auto head = pipeInToFile(path.data.raw);
+    // big content stays only in the entry, and anything that needs all of it reads it back from there
+    if (head.size() < constants.piped_head_size) copying.buffer = std::move(head);
     if (action == Action::Cut) writeToFile(path.metadata.originals, path.data.raw.string());
 }
 
+#if !defined(_WIN32) && !defined(_WIN64)
+// returns false once whoever is reading our output has gone away, like with cb paste | head
+static bool writeOut(const std::string_view& content) {
+    for (size_t written = 0; written < content.size();) {
+        auto len = write(fileno(stdout), content.data() + written, content.size() - written);
+        if (len == -1) {
+            if (errno == EINTR) continue;
+            if (errno == EPIPE) return false;
+            throw std::runtime_error("write() failed");
+        }
+        written += len;
+        successes.bytes += len;
+    }
+    return true;
+}
+
+static bool sendOut(const fs::path& file) {
+    int input = open(file.string().data(), O_RDONLY | O_CLOEXEC);
+    if (input == -1) throw fs::filesystem_error("Couldn't open", file, std::error_code(errno, std::generic_category()));
+    bool keepGoing = true;
+    ssize_t len = -1;
+#if defined(__linux__)
+    // let the kernel move the content without copying it through here
+    struct stat info;
+    bool toPipe = fstat(fileno(stdout), &info) == 0 && S_ISFIFO(info.st_mode);
+    while (true) {
+        len = toPipe ? splice(input, nullptr, fileno(stdout), nullptr, 1024 * 1024, SPLICE_F_MORE) : sendfile(fileno(stdout), input, nullptr, 1024 * 1024);
+        if (len > 0) {
+            successes.bytes += len;
+            continue;
+        }
+        if (len == 0) break;
+        if (errno == EINTR) continue;
+        if (errno == EPIPE) keepGoing = false;
+        break; // otherwise stdout is something the kernel can't send to directly, so finish by hand from wherever it stopped
+    }
+#endif
+    std::array<char, 65536> buffer;
+    while (keepGoing && len != 0) {
+        len = read(input, buffer.data(), buffer.size());
+        if (len == -1 && errno == EINTR) continue;
+        if (len == -1) {
+            close(input);
+            throw fs::filesystem_error("Couldn't read", file, std::error_code(errno, std::generic_category()));
+        }
+        keepGoing = writeOut({buffer.data(), static_cast<size_t>(len)});
+    }
+    close(input);
+    return keepGoing;
+}
+#endif
+
 void pipeOut() {
-    for (const auto& entry : fs::recursive_directory_iterator(path.data)) {
-        std::string content(fileContents(entry.path()).value());
 #if !defined(_WIN32) && !defined(_WIN64)
-        int len = write(fileno(stdout), content.data(), content.size());
-        if (len < 0) throw std::runtime_error("write() failed");
+    signal(SIGPIPE, SIG_IGN); // get EPIPE instead of getting killed so that we stop as soon as the reader leaves and still clean up
+    fflush(stdout);
+    if (path.isPacked(path.entry())) // packed entries only ever hold raw data, which gets read right from the pack
+        writeOut(path.rawDataFor(path.entry()).content());
+    else
+        for (const auto& entry : fs::recursive_directory_iterator(path.data)) {
+            if (entry.is_directory()) continue;
+            bool keepGoing = true;
+            if (entry.path().filename() == constants.data_file_name && isEncodedFile(entry.path())) // items are stored as they are, whatever they start with
+                streamFileContents(entry.path(), [&](const std::string_view& content) { return keepGoing = writeOut(content); });
+            else
+                keepGoing = sendOut(entry.path());
+            if (!keepGoing) break;
+        }
 #elif defined(_WIN32) || defined(_WIN64)
-        _setmode(_fileno(stdout), _O_BINARY);
+    _setmode(_fileno(stdout), _O_BINARY);
+    auto writeOut = [](const std::string_view& content) {
         fwrite(content.data(), sizeof(char), content.size(), stdout);
-#endif
-        fflush(stdout);
         successes.bytes += content.size();
-    }
+        return true;
+    };
+    if (path.isPacked(path.entry())) // packed entries only ever hold raw data, which gets read right from the pack
+        writeOut(path.rawDataFor(path.entry()).content());
+    else
+        for (const auto& entry : fs::recursive_directory_iterator(path.data)) {
+            if (entry.is_directory()) continue;
+            // stream the content out a piece at a time so that big (or compressed) entries never have to fit in memory all at once
+            if (entry.path().filename() == constants.data_file_name) {
+                streamFileContents(entry.path(), writeOut);
+                continue;
+            }
+            std::ifstream input(entry.path(), std::ios::binary); // items are stored as they are, whatever they start with
+            std::vector<char> buffer(65536);
+            while (input.read(buffer.data(), buffer.size()) || input.gcount() > 0)
+                writeOut(std::string_view(buffer.data(), input.gcount()));
+        }
+    fflush(stdout);
+#endif
     removeOldFiles();
 }
 
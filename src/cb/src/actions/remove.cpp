@@ -60,6 +60,7 @@ void removeRegex() {
                                  "stored.[blank]\n")
             );
     }
+    path.releaseUnusedObjects();
 }
 
 } // namespace PerformAction
\ No newline at end of file
@@ -14,6 +14,8 @@
     You should have received a copy of the GNU General Public License
     along with this program.  If not, see <https://www.gnu.org/licenses/>.*/
 #include "../clipboard.hpp"
+#include <charconv>
+#include <numeric>
 
 namespace PerformAction {
 
@@ -22,9 +24,43 @@ struct Result {
     std::string clipboard;
     unsigned long entry = 0;
     unsigned long score = 0;
-    size_t hash;
 };
 
+// Where a match is, without a copy of what it matched, so that only the results that end up shown need their content again
+struct Match {
+    Clipboard* clipboard = nullptr;
+    unsigned long entry = 0;
+    unsigned long score = 0;
+    std::string item; // the name of the item that matched, or empty if it was the raw data
+    fs::path file; // the stored file whose content matched, if it was one, with item being its path in the entry
+    std::vector<std::pair<size_t, size_t>> highlights; // where each part to highlight starts and how long it is
+};
+
+// Fuzzy matches rate somewhere in here depending on how good they are, which is always below what any other kind of match gets
+static constexpr unsigned long worstFuzzyRating = 100;
+static constexpr unsigned long bestFuzzyRating = 600;
+
+// Bolds each part of the content that matched, skipping any that don't fit
+static std::string highlighted(const std::string_view& content, const std::vector<std::pair<size_t, size_t>>& highlights) {
+    std::string preview;
+    size_t shown = 0;
+    for (const auto& [position, length] : highlights) {
+        if (position < shown || position >= content.size() || length == 0) continue;
+        auto end = std::min(position + length, content.size());
+        preview.append(content.substr(shown, position - shown)).append("\033[1m").append(content.substr(position, end - position)).append("\033[22m");
+        shown = end;
+    }
+    preview.append(content.substr(shown));
+    return preview;
+}
+
+// Higher scores first, and then newer entries, so the same search always keeps the same results however the threads went
+static bool isBetterMatch(const Match& one, const Match& two) {
+    if (one.score != two.score) return one.score > two.score;
+    if (one.entry != two.entry) return one.entry < two.entry;
+    return one.clipboard->name() < two.clipboard->name();
+}
+
 void displaySearchResults(const std::vector<Result>& results) {
     auto available = thisTerminalSize();
 
@@ -72,18 +108,161 @@ void displaySearchResults(const std::vector<Result>& results) {
 
 void displaySearchJSON(const std::vector<Result>& results) {
     printf("[\n");
-    for (size_t i = results.size() - 1; i > 0; i--) {
+    for (size_t i = results.size(); i > 0; i--) {
         printf("    {\n");
-        printf("        \"clipboard\": \"%s\",\n", results.at(i).clipboard.data());
-        printf("        \"entry\": %lu,\n", results.at(i).entry);
-        printf("        \"preview\": \"%s\",\n", JSONescape(results.at(i).preview).data());
-        printf("        \"score\": %lu\n", results.at(i).score);
+        printf("        \"clipboard\": \"%s\",\n", results.at(i - 1).clipboard.data());
+        printf("        \"entry\": %lu,\n", results.at(i - 1).entry);
+        printf("        \"preview\": \"%s\",\n", JSONescape(results.at(i - 1).preview).data());
+        printf("        \"score\": %lu\n", results.at(i - 1).score);
         printf("    }%s\n", i == 1 ? "" : ",");
     }
     printf("]\n");
 }
 
-void searchInternal(std::function<void(const std::vector<Result>&)> nextStep) {
+static void skipClass(const std::string& pattern, size_t& i) {
+    for (i++; i < pattern.size() && pattern[i] != ']'; i++)
+        if (pattern[i] == '\\') i++;
+}
+
+static void skipGroup(const std::string& pattern, size_t& i) {
+    for (int depth = 0; i < pattern.size(); i++) {
+        if (pattern[i] == '\\')
+            i++;
+        else if (pattern[i] == '[')
+            skipClass(pattern, i);
+        else if (pattern[i] == '(')
+            depth++;
+        else if (pattern[i] == ')' && --depth == 0)
+            return;
+    }
+}
+
+// The plain text any match of this regex has to contain, so the search index can rule out entries without it
+static std::vector<std::string> requiredLiterals(const std::string& pattern) {
+    std::vector<std::string> literals(1);
+    auto endLiteral = [&](const std::string& startWith = "") {
+        if (!literals.back().empty()) literals.emplace_back();
+        literals.back() = startWith;
+    };
+    auto skipLazy = [&](size_t& i) {
+        if (i + 1 < pattern.size() && pattern[i + 1] == '?') i++;
+    };
+    for (size_t i = 0; i < pattern.size(); i++) {
+        auto& current = literals.back();
+        switch (pattern[i]) {
+        case '|': // any one alternative might match instead, so nothing in particular is required
+            return {};
+        case '\\':
+            if (i + 1 >= pattern.size()) return {};
+            if (std::isalnum(static_cast<unsigned char>(pattern[i + 1]))) { // a character class, an assertion, or a character code
+                auto kind = pattern[++i];
+                if (kind == 'x')
+                    i += 2;
+                else if (kind == 'u')
+                    i += 4;
+                else if (kind == 'c')
+                    i += 1;
+                else if (std::isdigit(static_cast<unsigned char>(kind)))
+                    while (i + 1 < pattern.size() && std::isdigit(static_cast<unsigned char>(pattern[i + 1])))
+                        i++;
+                endLiteral();
+            } else
+                current += pattern[++i];
+            break;
+        case '(':
+            skipGroup(pattern, i);
+            endLiteral();
+            break;
+        case '[':
+            skipClass(pattern, i);
+            endLiteral();
+            break;
+        case '*':
+        case '?':
+            if (!current.empty()) current.pop_back();
+            skipLazy(i);
+            endLiteral();
+            break;
+        case '+': {
+            std::string repeated = current.empty() ? "" : current.substr(current.size() - 1);
+            skipLazy(i);
+            endLiteral(repeated);
+            break;
+        }
+        case '{': {
+            size_t close = pattern.find('}', i);
+            unsigned long minimum = 0;
+            auto [end, ec] = std::from_chars(pattern.data() + i + 1, pattern.data() + std::min(close, pattern.size()), minimum);
+            if (close == std::string::npos || ec != std::errc() || (*end != ',' && *end != '}')) {
+                current += '{';
+                break;
+            }
+            std::string repeated = current.empty() ? "" : current.substr(current.size() - 1);
+            if (minimum == 0 && !current.empty()) current.pop_back();
+            i = close;
+            skipLazy(i);
+            endLiteral(minimum == 0 ? "" : repeated);
+            break;
+        }
+        case '.':
+        case '^':
+        case '$':
+            endLiteral();
+            break;
+        default:
+            current += pattern[i];
+        }
+    }
+    return literals;
+}
+
+// Everything about a query that doesn't depend on what it's being compared to, worked out once before the search starts
+struct QueryPlan {
+    std::string text;
+    bool isLiteral = false; // without any regex characters, matching it is the same as comparing and finding it as plain text
+    std::regex regex;
+    std::vector<std::string> literals; // what any regex match has to contain
+    std::vector<size_t> literalIds; // where those literals are in the list that all the queries share
+};
+
+// Like grep, don't look through files that seem to be binary going by how they start, since a match in one can't be shown anyway
+static bool looksLikeText(const std::string_view& head) {
+    if (head.find('\0') != std::string_view::npos) return false;
+    auto type = inferMIMEType(head);
+    return !type || type->starts_with("text/") || type->ends_with("xml");
+}
+
+static QueryPlan compiledQuery(const std::string& query) {
+    QueryPlan plan;
+    plan.text = query;
+    plan.isLiteral = query.find_first_of("\\^$.|?*+()[]{}") == std::string::npos;
+    if (plan.isLiteral)
+        plan.literals = {query};
+    else {
+        plan.regex = std::regex(query, std::regex::ECMAScript | std::regex::optimize);
+        plan.literals = requiredLiterals(query);
+    }
+    return plan;
+}
+
+// Which entries could match any of the queries other than fuzzily, going by the search index
+static std::vector<bool> possibleMatches(Clipboard& clipboard, const std::vector<QueryPlan>& queries) {
+    std::vector<bool> candidates(clipboard.entryIndex.size(), false);
+    auto mark = [&](const std::vector<unsigned long>& entries) {
+        for (const auto& entry : entries)
+            candidates.at(entry) = true;
+    };
+    for (const auto& plan : queries) {
+        mark(clipboard.entriesPossiblyContaining(plan.literals));
+        if (!plan.isLiteral) mark(clipboard.entriesPossiblyContaining({plan.text})); // an exact match has to have the query itself, even if it has regex characters
+    }
+    if (contents_option) // the index only knows the names of what's in these
+        for (unsigned long entry = 0; entry < clipboard.entryIndex.size(); entry++)
+            if (clipboard.recordFor(entry).content != EntryContent::RawData) candidates.at(entry) = true;
+    return candidates;
+}
+
+void searchInternal(std::function<void(const std::vector<Result>&)> nextStep, const size_t& defaultLimit) {
     if (copying.items.empty())
         error_exit(
                 "%s",
@@ -92,14 +271,41 @@ void searchInternal(std::function<void(const std::vector<Result>&)> nextStep) {
                 )
         );
 
-    std::vector<std::string> queries;
-    std::transform(copying.items.begin(), copying.items.end(), std::back_inserter(queries), [](const auto& item) { return item.string(); });
+    // bad regex is an error for the whole search, so find out before reading anything
+    std::vector<QueryPlan> queries;
+    for (const auto& item : copying.items) {
+        try {
+            queries.emplace_back(compiledQuery(item.string()));
+        } catch (const std::regex_error& e) {
+            error_exit(
+                    formatColors("[error][inverse] ✘ [noinverse] CB couldn't process your query as regex. (Specific error: %s) [help]⬤ Try entering a valid regex instead, like [bold]cb search "
+                                 "\"Foobar.*\"[nobold].[blank]\n"),
+                    std::string(e.what())
+            );
+        }
+    }
+
+    // all the queries' literals go in one list so that each entry only has to be looked through once for all of them
+    std::vector<std::string> literals;
+    for (auto& plan : queries)
+        for (const auto& literal : plan.literals) {
+            if (literal.empty()) continue;
+            auto existing = std::find(literals.begin(), literals.end(), literal);
+            plan.literalIds.emplace_back(existing - literals.begin());
+            if (existing == literals.end()) literals.emplace_back(literal);
+        }
+    std::optional<LiteralAutomaton> automaton;
+    if (literals.size() >= constants.literal_automaton_minimum) automaton.emplace(literals);
+    auto literalPositions = [&](const std::string_view& content) {
+        if (automaton) return automaton->firstPositions(content);
+        std::vector<size_t> positions;
+        for (const auto& literal : literals)
+            positions.emplace_back(findLiteral(content, literal));
+        return positions;
+    };
 
     std::vector<Clipboard> targets;
-    std::vector<Result> results;
-
-    std::hash<std::string> hashString;
-    std::hash<unsigned long> hashULong;
+    size_t limit = limit_option > 0 ? limit_option : defaultLimit;
 
     if (all_option) {
         for (const auto& entry : fs::directory_iterator(global_path.temporary))
@@ -109,96 +315,205 @@ void searchInternal(std::function<void(const std::vector<Result>&)> nextStep) {
     } else
         targets.emplace_back(path);
 
-    // std::cerr << "distance between foo and fobobar is " << levenshteinDistance("foo", "fobobar") << std::endl;
-
-    // exit(0);
-
-    auto contentMatchRating = [&](const std::string& content, const std::string& query) -> std::optional<Result> {
-        Result result;
+    auto contentMatchRating = [&](const std::string_view& content, const QueryPlan& query, const std::vector<size_t>& positions) -> std::optional<Match> {
+        Match match;
+        auto matched = [&](const unsigned long& score, const size_t& position, const size_t& length) {
+            match.score = score;
+            match.highlights = {{position, length}};
+        };
 
         // check if the content matches the query
-        try {
-            if (content == query) {
-                result.score = 1000;
-                result.preview = "\033[1m" + content + "\033[22m";
-            } else if (std::regex_match(content, std::regex(query))) { // then check if the content regex matches the query
-                result.score = 800;
-                result.preview = "\033[1m" + content + "\033[22m";
-            } else if (std::smatch sm; std::regex_search(content, sm, std::regex(query))) { // then do a regex search of the content for the query
-                result.score = 700;
-                result.preview = content.substr(0, sm.position(0)) + "\033[1m" + sm.str(0) + "\033[22m" + content.substr(sm.position(0) + sm.length(0));
-            } else if (size_t distance; content.size() < 1000 && (distance = levenshteinDistance(content, query)) < 25) { // then do a fuzzy search of the content for the query
-                result.score = 600 - (distance * 20);
-                result.preview = "\033[1m" + content + "\033[22m";
+        if (content == query.text) {
+            matched(1000, 0, content.size());
+        } else if (query.isLiteral) { // plain text can't match all of anything but itself, so only look for it inside the content
+            if (auto position = query.literalIds.empty() ? 0 : positions[query.literalIds.front()]; position != std::string_view::npos) matched(700, position, query.text.size());
+        } else if (std::any_of(query.literalIds.begin(), query.literalIds.end(), [&](const auto& literal) { return positions[literal] == std::string_view::npos; })) {
+            // the regex can't match without all of its literals, so don't bother running it
+        } else if (std::regex_match(content.begin(), content.end(), query.regex)) { // then check if the content regex matches the query
+            matched(800, 0, content.size());
+        } else if (std::match_results<std::string_view::const_iterator> sm; std::regex_search(content.begin(), content.end(), sm, query.regex)) { // then do a regex search of the content for the query
+            matched(700, sm.position(0), sm.length(0));
+        }
+        if (match.score == 0) { // then do a fuzzy search of the content for the query
+            if (auto fuzzy = fuzzyMatch(content, query.text); fuzzy.has_value()) {
+                match.score = worstFuzzyRating + fuzzy->score * (bestFuzzyRating - worstFuzzyRating) / 1000;
+                for (const auto& position : fuzzy->positions)
+                    if (!match.highlights.empty() && match.highlights.back().first + match.highlights.back().second == position)
+                        match.highlights.back().second++;
+                    else
+                        match.highlights.emplace_back(position, 1);
             }
-        } catch (const std::regex_error& e) {
-            error_exit(
-                    formatColors("[error][inverse] ✘ [noinverse] CB couldn't process your query as regex. (Specific error: %s) [help]⬤ Try entering a valid regex instead, like [bold]cb search "
-                                 "\"Foobar.*\"[nobold].[blank]\n"),
-                    std::string(e.what())
-            );
         }
 
-        if (result.score > 0) return result;
+        if (match.score > 0) return match;
 
         return std::nullopt;
     };
 
-    auto combineHashes = [](size_t one, size_t two) -> size_t {
-        return one ^ (two + 0x9e3779b9 + (one << 6) + (one >> 2)); // from Boost
+    // everything that touches a clipboard's records, pack table or search index happens here first, so the threads below only read them
+    struct Candidate {
+        Clipboard* clipboard;
+        unsigned long entry;
+        bool isRawData;
+        bool isIndexed;
     };
-
+    std::vector<Candidate> candidates;
+    std::vector<Candidate> fuzzyCandidates; // the index says these can't match except fuzzily
     for (auto& clipboard : targets) {
-        for (auto entry = 0; entry < clipboard.entryIndex.size(); entry++) {
-            auto adjustScoreByEntryPosition = [&](Result& result) {
-                float multiplier = 1.0f - (static_cast<float>(entry) / (20.0f * static_cast<float>(clipboard.entryIndex.size())));
-                float newScore = static_cast<float>(result.score) * multiplier;
-                result.score = static_cast<unsigned long>(newScore);
-            };
-            clipboard.setEntry(entry);
-            if (clipboard.holdsRawDataInCurrentEntry()) {
-                for (const auto& query : queries) {
-                    if (auto rating = contentMatchRating(fileContents(clipboard.data.raw).value(), query); rating.has_value()) {
-                        rating->clipboard = clipboard.name();
+        std::vector<unsigned long> entries(clipboard.entryIndex.size());
+        std::iota(entries.begin(), entries.end(), 0);
+        clipboard.prefetchEntryRecords(entries);
+        if (!entries.empty()) clipboard.packedEntryFor(clipboard.entryIndex.front()); // loads the pack table if there is one
+        auto possible = possibleMatches(clipboard, queries);
+        for (unsigned long entry = 0; entry < clipboard.entryIndex.size(); entry++)
+            (possible.at(entry) ? candidates : fuzzyCandidates).emplace_back(&clipboard, entry, clipboard.recordFor(entry).content == EntryContent::RawData, clipboard.isIndexedForSearch(entry));
+    }
+
+    // each thread only keeps the best few matches it's seen, with the worst of them on top of the heap to be pushed out next
+    auto keep = [&](std::vector<Match>& kept, Match&& match) {
+        if (kept.size() < limit) {
+            kept.emplace_back(std::move(match));
+            std::push_heap(kept.begin(), kept.end(), isBetterMatch);
+        } else if (isBetterMatch(match, kept.front())) {
+            std::pop_heap(kept.begin(), kept.end(), isBetterMatch);
+            kept.back() = std::move(match);
+            std::push_heap(kept.begin(), kept.end(), isBetterMatch);
+        }
+    };
+
+    std::mutex indexing;
+    auto searchCandidate = [&](const Candidate& candidate, std::vector<Match>& kept) {
+        auto& clipboard = *candidate.clipboard;
+        auto entry = candidate.entry;
+        std::optional<Match> best; // an entry only shows up once, with whatever matched it best
+        auto rate = [&](const std::string_view& content, const std::string_view& item, const fs::path& file = {}) {
+            auto positions = literalPositions(content);
+            for (const auto& query : queries) {
+                if (auto rating = contentMatchRating(content, query, positions); rating.has_value()) {
+                    float multiplier = 1.0f - (static_cast<float>(entry) / (20.0f * static_cast<float>(clipboard.entryIndex.size())));
+                    rating->score = static_cast<unsigned long>(static_cast<float>(rating->score) * multiplier);
+                    if (!best || rating->score > best->score) {
+                        rating->clipboard = &clipboard;
                         rating->entry = entry;
-                        rating->hash = combineHashes(hashString(clipboard.name()), hashULong(entry));
-                        adjustScoreByEntryPosition(rating.value());
-                        results.emplace_back(rating.value());
+                        rating->item = item;
+                        rating->file = file;
+                        best = std::move(rating);
                     }
                 }
-            } else {
-                for (const auto& item : fs::directory_iterator(clipboard.data)) {
-                    for (const auto& query : queries) {
-                        if (auto rating = contentMatchRating(item.path().filename().string(), query); rating.has_value()) {
-                            rating->clipboard = clipboard.name();
-                            rating->entry = entry;
-                            rating->hash = combineHashes(hashString(clipboard.name()), hashULong(entry));
-                            adjustScoreByEntryPosition(rating.value());
-                            results.emplace_back(rating.value());
-                        }
-                    }
+            }
+        };
+        auto index = [&](const std::string_view& content) {
+            if (candidate.isIndexed) return;
+            auto indexed = indexedContent(content);
+            std::lock_guard lock(indexing);
+            clipboard.indexForSearch(entry, std::move(indexed));
+        };
+        if (candidate.isRawData) {
+            auto content = clipboard.rawDataFor(entry);
+            index(content.content());
+            rate(content.content(), "");
+        } else {
+            std::string names;
+            for (const auto& item : fs::directory_iterator(clipboard.entryPathFor(entry))) {
+                auto name = item.path().filename().string();
+                rate(name, name);
+                names.append(name).append(1, '\n');
+            }
+            index(names);
+            if (contents_option) {
+                auto directory = clipboard.entryPathFor(entry);
+                for (const auto& file : fs::recursive_directory_iterator(directory)) {
+                    if (!file.is_regular_file() || file.file_size() == 0 || file.file_size() > constants.search_contents_limit) continue;
+                    FileView stored(file.path()); // big files get mapped instead of read, so skipping a binary one only touches its start
+                    if (!looksLikeText(stored.content().substr(0, constants.preview_head_size))) continue;
+                    rate(stored.content(), fs::relative(file.path(), directory).string(), file.path());
                 }
             }
         }
-    }
+        if (best) keep(kept, std::move(best.value()));
+    };
 
-    if (results.empty())
-        error_exit("%s", formatColors("[error][inverse] ✘ [noinverse] CB couldn't find anything matching your query.[blank] [help]⬤ Try searching for something else instead.[blank]\n"));
+    // every thread keeps its own results and takes the next entry when it's done with one, so big entries don't hold up the rest
+    std::vector<Match> matches;
+    auto searchAll = [&](const std::vector<Candidate>& batch) {
+        auto totalThreads = std::min<size_t>(suitableThreadAmount(), batch.size());
+        std::vector<std::vector<Match>> found(std::max<size_t>(totalThreads, 1));
+        std::vector<std::exception_ptr> failures(found.size());
+        if (totalThreads <= 1) {
+            for (const auto& candidate : batch)
+                searchCandidate(candidate, found.front());
+        } else {
+            std::atomic<size_t> next = 0;
+            std::vector<std::thread> threads;
+            for (size_t thread = 0; thread < totalThreads; thread++)
+                threads.emplace_back([&, thread] {
+                    try {
+                        for (auto candidate = next++; candidate < batch.size(); candidate = next++)
+                            searchCandidate(batch[candidate], found[thread]);
+                    } catch (...) {
+                        failures[thread] = std::current_exception();
+                        next = batch.size();
+                    }
+                });
+            for (auto& thread : threads)
+                thread.join();
+            for (const auto& failure : failures)
+                if (failure) std::rethrow_exception(failure);
+        }
+        for (auto& some : found)
+            for (auto& match : some)
+                keep(matches, std::move(match));
+    };
+
+    // fuzzy matches always rate below the rest, so the entries that can only match fuzzily only need looking at if there's room for them
+    searchAll(candidates);
+    if (matches.size() < limit || matches.front().score <= bestFuzzyRating) searchAll(fuzzyCandidates);
+
+    for (auto& clipboard : targets)
+        clipboard.saveSearchIndex();
 
-    std::sort(results.begin(), results.end(), [](const Result& one, const Result& two) { return one.hash < two.hash; });
-    results.erase(std::unique(results.begin(), results.end(), [](const Result& one, const Result& two) { return one.hash == two.hash; }), results.end());
+    if (matches.empty())
+        error_exit("%s", formatColors("[error][inverse] ✘ [noinverse] CB couldn't find anything matching your query.[blank] [help]⬤ Try searching for something else instead.[blank]\n"));
 
-    std::sort(results.begin(), results.end(), [](const Result& one, const Result& two) { return one.score < two.score; });
+    // only now read what the survivors matched to show it, worst first so the best ends up closest to the prompt
+    std::sort(matches.begin(), matches.end(), [](const Match& one, const Match& two) { return isBetterMatch(two, one); });
+    std::vector<Result> results;
+    for (const auto& match : matches) {
+        FileView stored;
+        if (!match.file.empty())
+            stored = FileView(match.file);
+        else if (match.item.empty())
+            stored = match.clipboard->rawDataFor(match.entry);
+        std::string_view content = match.file.empty() && !match.item.empty() ? std::string_view(match.item) : stored.content();
+        auto highlights = match.highlights;
+        std::string preview;
+        if (!match.file.empty() && !highlights.empty()) { // a whole file is too much to show, so only show the line with the match and where it's from
+            auto position = std::min(highlights.front().first, content.size());
+            auto start = position == 0 ? std::string_view::npos : content.rfind('\n', position - 1);
+            start = start == std::string_view::npos ? 0 : start + 1;
+            auto end = std::min(content.find('\n', position), content.size());
+            content = content.substr(start, end - start);
+            for (auto& [where, length] : highlights) {
+                length = where < end ? std::min(length, end - where) : 0;
+                where = where >= start ? where - start : content.size();
+            }
+            preview = match.item + ": ";
+        }
+        preview += highlighted(content, highlights);
+        results.emplace_back(std::move(preview), match.clipboard->name(), match.entry, match.score);
+    }
 
     nextStep(results);
 }
 
 void search() {
-    searchInternal(displaySearchResults);
+    // the title, legend, and prompt take up three lines, and anything past the rest would scroll off the top anyway
+    auto rows = thisTerminalSize().rows;
+    searchInternal(displaySearchResults, rows > 4 ? rows - 3 : 1);
 }
 
 void searchJSON() {
-    searchInternal(displaySearchJSON);
+    searchInternal(displaySearchJSON, std::numeric_limits<size_t>::max());
 }
 
 } // namespace PerformAction
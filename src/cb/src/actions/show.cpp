@@ -28,12 +28,16 @@ void show() {
     auto available = thisTerminalSize();
 
     if (path.holdsRawDataInCurrentEntry()) {
-        std::string content(fileContents(path.data.raw).value());
-        content = makeControlCharactersVisible(content, available.columns);
-        fprintf(stderr, clipboard_text_contents_message().data(), std::min(static_cast<size_t>(250), content.size()), clipboard_name.data());
+        // only read as much as we're going to show, and get the rest of the size without reading it
+        bool packed = path.isPacked(path.entry());
+        auto size = packed ? path.recordFor(path.entry()).bytes : originalFileSize(path.data.raw);
+        auto head = packed ? std::string(path.rawDataFor(path.entry()).content().substr(0, constants.preview_head_size)) : fileHead(path.data.raw, constants.preview_head_size);
+        auto content = makeControlCharactersVisible(head, available.columns);
+        auto total = std::max<size_t>(content.size(), size);
+        fprintf(stderr, clipboard_text_contents_message().data(), std::min(static_cast<size_t>(250), total), clipboard_name.data());
         fprintf(stderr, formatColors("[bold][info]%s\n[blank]").data(), content.substr(0, 250).data());
-        if (content.size() > 250) {
-            fprintf(stderr, and_more_items_message().data(), content.size() - 250);
+        if (total > 250) {
+            fprintf(stderr, and_more_items_message().data(), total - 250);
         }
         return;
     }
@@ -74,6 +78,7 @@ void showFilepaths() {
         std::transform(copying.items.begin(), copying.items.end(), std::back_inserter(regexes), [](const auto& item) { return std::regex(item.string()); });
     }
 
+    path.unpackEntry(path.entryIndex.at(path.entry())); // whoever asked for paths is going to read them, so packed content needs a file of its own again
     std::vector<fs::path> paths(fs::directory_iterator(path.data), fs::directory_iterator {});
     if (!regexes.empty())
         paths.erase(
@@ -18,11 +18,23 @@
 namespace PerformAction {
 
 std::vector<Clipboard> clipboardsWithContent() {
-    std::vector<Clipboard> clipboards;
+    std::vector<Clipboard> candidates;
     for (const auto& entry : fs::directory_iterator(global_path.temporary))
-        if (auto cb = Clipboard(entry.path().filename().string()); cb.holdsDataInCurrentEntry()) clipboards.emplace_back(cb);
+        candidates.emplace_back(entry.path().filename().string());
     for (const auto& entry : fs::directory_iterator(global_path.persistent))
-        if (auto cb = Clipboard(entry.path().filename().string()); cb.holdsDataInCurrentEntry()) clipboards.emplace_back(cb);
+        candidates.emplace_back(entry.path().filename().string());
+
+    std::vector<std::pair<Clipboard*, unsigned long>> currentEntries;
+    for (auto& cb : candidates)
+        currentEntries.emplace_back(&cb, cb.entry());
+    prefetchEntryRecords(currentEntries);
+
+    std::vector<Clipboard> clipboards;
+    for (auto& cb : candidates) {
+        bool holdsData = cb.freshRecordFor(cb.entry()).content != EntryContent::Nothing;
+        cb.saveEntryIndex();
+        if (holdsData) clipboards.emplace_back(std::move(cb));
+    }
     std::sort(clipboards.begin(), clipboards.end(), [](const auto& a, const auto& b) { return a.name() < b.name(); });
     return clipboards;
 }
@@ -54,19 +66,21 @@ void status() {
         int widthRemaining = available.columns - (clipboard.name().length() + 5 + longestClipboardLength);
         fprintf(stderr, formatColors("[info]\033[%ldG┃\r┃ [bold]%*s%s[nobold]│ [blank]").data(), available.columns, longestClipboardLength - clipboard.name().length(), "", clipboard.name().data());
 
-        if (clipboard.holdsRawDataInCurrentEntry()) {
-            std::string content(fileContents(clipboard.data.raw).value());
-            if (auto type = inferMIMEType(content); type.has_value())
-                content = "\033[7m\033[1m " + std::string(type.value()) + ", " + formatBytes(content.length()) + " \033[22m\033[27m";
+        const auto& record = clipboard.freshRecordFor(clipboard.entry());
+
+        if (record.content == EntryContent::RawData) {
+            std::string content;
+            if (auto type = record.mimeType(); !type.empty())
+                content = "\033[7m\033[1m " + std::string(type) + ", " + formatBytes(record.bytes) + " \033[22m\033[27m";
             else
-                content = makeControlCharactersVisible(content, available.columns);
+                content = makeControlCharactersVisible(std::string(record.previewText()), available.columns);
             fprintf(stderr, formatColors("[help]%s[blank]\n").data(), content.substr(0, widthRemaining).data());
             clipboard.releaseLock();
             continue;
         }
 
-        for (bool first = true; const auto& entry : fs::directory_iterator(clipboard.data)) {
-            int entryWidth = entry.path().filename().string().length();
+        for (bool first = true; const auto& [filename, isDirectory] : record.itemNames()) {
+            int entryWidth = filename.length();
 
             if (widthRemaining <= 0) break;
 
@@ -79,10 +93,10 @@ void status() {
 
             if (entryWidth <= widthRemaining) {
                 std::string stylizedEntry;
-                if (entry.is_directory())
-                    stylizedEntry = "\033[4m" + entry.path().filename().string() + "\033[24m";
+                if (isDirectory)
+                    stylizedEntry = "\033[4m" + std::string(filename) + "\033[24m";
                 else
-                    stylizedEntry = "\033[1m" + entry.path().filename().string() + "\033[22m";
+                    stylizedEntry = "\033[1m" + std::string(filename) + "\033[22m";
                 fprintf(stderr, formatColors("[help]%s[blank]").data(), stylizedEntry.data());
                 widthRemaining -= entryWidth;
                 first = false;
@@ -104,20 +118,19 @@ void statusJSON() {
 
     auto clipboards_with_contents = clipboardsWithContent();
 
-    for (const auto& clipboard : clipboards_with_contents) {
+    for (auto& clipboard : clipboards_with_contents) {
 
         printf("    \"%s\": ", clipboard.name().data());
 
-        if (clipboard.holdsRawDataInCurrentEntry()) {
-            std::string content(fileContents(clipboard.data.raw).value());
-            if (auto type = inferMIMEType(content); type.has_value()) {
+        if (const auto& record = clipboard.freshRecordFor(clipboard.entry()); record.content == EntryContent::RawData) {
+            if (auto type = record.mimeType(); !type.empty()) {
                 printf("{\n");
-                printf("        \"dataType\": \"%s\",\n", type.value().data());
-                printf("        \"dataSize\": %zu,\n", content.length());
+                printf("        \"dataType\": \"%s\",\n", std::string(type).data());
+                printf("        \"dataSize\": %zu,\n", static_cast<size_t>(record.bytes));
                 printf("        \"path\": \"%s\"\n", clipboard.data.raw.string().data());
                 printf("    }");
             } else {
-                printf("\"%s\"", JSONescape(content).data());
+                printf("\"%s\"", JSONescape(FileView(clipboard.data.raw).content()).data());
             }
         } else {
             printf("[");
@@ -45,6 +45,10 @@ void swap() {
     swapTargetDestination.replace_extension("swap");
 
     try {
+        // chunked content only makes sense in the clipboard that stores its chunks
+        decodeFile(path.data.raw);
+        decodeFile(destination.data.raw);
+
         fs::copy(destination.data, swapTargetSource, fs::copy_options::recursive);
         fs::copy(path.data, swapTargetDestination, fs::copy_options::recursive);
 
@@ -53,6 +57,13 @@ void swap() {
 
         fs::rename(swapTargetSource, path.data);
         fs::rename(swapTargetDestination, destination.data);
+
+        path.releaseUnusedObjects();
+        destination.releaseUnusedObjects();
+
+        path.updateEntryRecord();
+        destination.updateEntryRecord();
+        destination.saveEntryIndex();
     } catch (const fs::filesystem_error& e) {
         copying.failedItems.emplace_back(destination_name, e.code());
     }
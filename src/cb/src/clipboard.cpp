@@ -14,6 +14,7 @@
     You should have received a copy of the GNU General Public License
     along with this program.  If not, see <https://www.gnu.org/licenses/>.*/
 #include "clipboard.hpp"
+#include <openssl/evp.h>
 #include <openssl/sha.h>
 
 Clipboard::Clipboard(const std::string& clipboard_name, const unsigned long& clipboard_entry) {
@@ -24,6 +25,18 @@ Clipboard::Clipboard(const std::string& clipboard_name, const unsigned long& cli
 
     root = (is_persistent ? global_path.persistent : global_path.temporary) / this_name;
 
+    metadata = root / constants.metadata_directory;
+    metadata.notes = metadata / constants.notes_name;
+    metadata.originals = metadata / constants.original_files_name;
+    metadata.lock = metadata / constants.lock_name;
+    metadata.ignore = metadata / constants.ignore_regex_name;
+    metadata.ignore_secret = metadata / constants.ignore_secret_name;
+    metadata.index = metadata / constants.entry_index_name;
+    metadata.search_index = metadata / constants.search_index_name;
+    metadata.search_additions = metadata / constants.search_additions_name;
+
+    packs = root / constants.packs_directory;
+
     entryIndex = generatedEntryIndex();
 
     try {
@@ -40,14 +53,10 @@ Clipboard::Clipboard(const std::string& clipboard_name, const unsigned long& cli
 
     data.raw = data / constants.data_file_name;
 
-    metadata = root / constants.metadata_directory;
-    metadata.notes = metadata / constants.notes_name;
-    metadata.originals = metadata / constants.original_files_name;
-    metadata.lock = metadata / constants.lock_name;
-    metadata.ignore = metadata / constants.ignore_regex_name;
-    metadata.ignore_secret = metadata / constants.ignore_secret_name;
 
-    fs::create_directories(data);
+    objects = root / constants.objects_directory;
+
+    if (!isPacked(this_entry)) fs::create_directories(data); // packed entries get read from their pack until something changes them
     fs::create_directories(metadata);
 }
 
@@ -56,6 +65,18 @@ std::deque<unsigned long> Clipboard::generatedEntryIndex() {
     std::deque<unsigned long> pathNames;
     fs::path entriesDir = root / constants.data_directory;
     fs::create_directories(entriesDir);
+    if (loadEntryIndex() && !entryRecords.empty()) { // nothing was added or removed since the index was saved, so skip reading the directory
+        for (const auto& [entry, record] : entryRecords)
+            pathNames.emplace_back(entry);
+        std::sort(pathNames.begin(), pathNames.end(), std::greater<>());
+        return pathNames;
+    }
+    return scannedEntryIndex();
+}
+
+std::deque<unsigned long> Clipboard::scannedEntryIndex() {
+    std::deque<unsigned long> pathNames;
+    fs::path entriesDir = root / constants.data_directory;
 #if defined(__linux__) || defined(__unix__) || defined(__APPLE__)
     auto dirptr = opendir(entriesDir.string().data());
     char* endptr = nullptr;
@@ -71,6 +92,8 @@ std::deque<unsigned long> Clipboard::generatedEntryIndex() {
             pathNames.emplace_back(std::stoul(entry.path().filename().string()));
         } catch (...) {}
 #endif
+    for (const auto& [entry, packed] : packedEntries())
+        pathNames.emplace_back(entry);
     if (pathNames.empty()) pathNames.emplace_back(0);
     std::sort(pathNames.begin(), pathNames.end(), std::greater<>());
     // auto now = std::chrono::system_clock::now();
@@ -78,7 +101,8 @@ std::deque<unsigned long> Clipboard::generatedEntryIndex() {
     return pathNames;
 }
 
-bool Clipboard::holdsRawDataInCurrentEntry() const {
+bool Clipboard::holdsRawDataInCurrentEntry() {
+    if (auto packed = packedEntryFor(entryIndex.at(this_entry))) return packed->length > 0;
     std::error_code ec;
     bool empty = fs::is_empty(data.raw, ec);
     if (ec) return false; // errors out if the file doesn't exist, return false to save on a syscall
@@ -86,6 +110,7 @@ bool Clipboard::holdsRawDataInCurrentEntry() const {
 }
 
 bool Clipboard::holdsDataInCurrentEntry() {
+    if (isPacked(this_entry)) return holdsRawDataInCurrentEntry();
     if (fs::is_empty(data)) return false;
     if (holdsRawDataInCurrentEntry()) return true;
     for (const auto& entry : fs::directory_iterator(data))
@@ -121,10 +146,16 @@ void Clipboard::applyIgnoreRules() {
     if (holdsIgnoreRegexes()) {
         auto regexes = ignoreRegexes();
         if (holdsRawDataInCurrentEntry()) {
-            auto content = fileContents(data.raw).value();
-            for (const auto& regex : regexes)
-                content = std::regex_replace(content, regex, "");
-            writeToFile(data.raw, content);
+            FileView original(data.raw);
+            std::string content;
+            for (bool first = true; const auto& regex : regexes) {
+                if (first)
+                    std::regex_replace(std::back_inserter(content), original.content().begin(), original.content().end(), regex, "");
+                else
+                    content = std::regex_replace(content, regex, "");
+                first = false;
+            }
+            if (content != original.content()) writeToFile(data.raw, content);
         } else
             for (const auto& regex : regexes)
                 for (const auto& entry : fs::directory_iterator(data))
@@ -134,18 +165,17 @@ void Clipboard::applyIgnoreRules() {
     if (holdsIgnoreSecrets()) {
         auto secrets = ignoreSecrets();
         if (!holdsRawDataInCurrentEntry()) return;
-        auto content = fileContents(data.raw).value();
+        // hash the content as it streams by so that big entries don't have to fit in memory
         std::array<unsigned char, SHA512_DIGEST_LENGTH> hash;
-        for (const auto& secret : secrets) {
-            SHA512(reinterpret_cast<const unsigned char*>(content.data()), content.size(), hash.data());
-            std::stringstream ss;
-            for (const auto& byte : hash)
-                ss << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(byte);
-            if (ss.str() == secret) {
-                writeToFile(data.raw, "");
-                break;
-            }
-        }
+        auto context = EVP_MD_CTX_new();
+        EVP_DigestInit_ex(context, EVP_sha512(), nullptr);
+        streamFileContents(data.raw, [&](const std::string_view& content) { return EVP_DigestUpdate(context, content.data(), content.size()) == 1; });
+        EVP_DigestFinal_ex(context, hash.data(), nullptr);
+        EVP_MD_CTX_free(context);
+        std::stringstream ss;
+        for (const auto& byte : hash)
+            ss << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(byte);
+        if (std::find(secrets.begin(), secrets.end(), ss.str()) != secrets.end()) writeToFile(data.raw, "");
     }
 }
 
@@ -207,8 +237,8 @@ fs::path Clipboard::entryPathFor(const unsigned long& entry) {
 }
 
 bool Clipboard::holdsData() {
-    for (const auto& entry : entryIndex)
-        if (!fs::is_empty(entryPathFor(entry))) return true;
+    for (unsigned long entry = 0; entry < entryIndex.size(); entry++)
+        if (recordFor(entry).content != EntryContent::Nothing) return true;
     return false;
 }
 
@@ -232,18 +262,8 @@ void Clipboard::trimHistoryEntries() {
                 maximumBytes = std::stold(setting) * 1024.0;
             else if (lastTwoChars.at(1) == 'b')
                 maximumBytes = std::stoull(setting);
-            else if (lastTwoChars.at(1) == 'y')
-                maximumSeconds = std::stold(setting) * 60.0 * 60.0 * 24.0 * 365.0;
-            else if (lastTwoChars.at(1) == 'm')
-                maximumSeconds = std::stold(setting) * 60.0 * 60.0 * 24.0 * 30.0;
-            else if (lastTwoChars.at(1) == 'w')
-                maximumSeconds = std::stold(setting) * 60.0 * 60.0 * 24.0 * 7.0;
-            else if (lastTwoChars.at(1) == 'd')
-                maximumSeconds = std::stold(setting) * 60.0 * 60.0 * 24.0;
-            else if (lastTwoChars.at(1) == 'h')
-                maximumSeconds = std::stold(setting) * 60.0 * 60.0;
-            else if (lastTwoChars.at(1) == 's')
-                maximumSeconds = std::stoul(setting);
+            else if (auto duration = parsedDuration(setting))
+                maximumSeconds = duration->count();
             else
                 maximumEntries = std::stoul(setting);
         } catch (...) {}
@@ -253,39 +273,70 @@ void Clipboard::trimHistoryEntries() {
     // std::cout << "maximumSeconds = " << maximumSeconds << std::endl;
     // std::cout << "maximumEntries = " << maximumEntries << std::endl;
 
+    auto startingEntries = entryIndex.size();
+
     if (maximumBytes > 0) {
-        size_t startingClipboardSize = totalDirectorySize(root);
-
-        while (startingClipboardSize > maximumBytes) {
-            auto oldestPath = entryPathFor(entryIndex.size() - 1);
-            size_t oldestEntrySize = totalDirectorySize(oldestPath);
-            fs::remove_all(oldestPath);
-            entryIndex.pop_back();
-            startingClipboardSize -= oldestEntrySize;
-        }
+        // every entry's record keeps what it takes up, so this is a running total and not a walk of the whole clipboard
+        // (objects are linked from the entries that use them and packed entries count only what they still use, same as before)
+        while (totalStoredBytes() > maximumBytes && entryIndex.size() > 1)
+            removeOldestEntry();
     }
 
     if (maximumSeconds > 0) {
         auto now = std::chrono::system_clock::now();
-#if defined(__linux__) || defined(__unix__) || defined(__APPLE__)
-        struct stat info;
-        auto lastModified = [&](const fs::path path) {
-            if (stat(path.string().data(), &info) != 0) return now;
-            return std::chrono::system_clock::from_time_t(info.st_mtime);
-        };
-
-        while (lastModified(entryPathFor(entryIndex.size() - 1)) < now - std::chrono::seconds(maximumSeconds)) {
-            fs::remove_all(entryPathFor(entryIndex.size() - 1));
-            entryIndex.pop_back();
-        }
-#endif
+        auto lastModified = [&](const unsigned long& entry) { return std::chrono::file_clock::to_sys(recordFor(entry).lastWriteTime()); };
+
+        while (entryIndex.size() > 1 && lastModified(entryIndex.size() - 1) < now - std::chrono::seconds(maximumSeconds))
+            removeOldestEntry();
     }
 
     if (maximumEntries > 0) {
-        if (entryIndex.size() <= maximumEntries || maximumEntries == 0) return;
-        while (entryIndex.size() > maximumEntries) {
-            fs::remove_all(entryPathFor(entryIndex.size() - 1));
-            entryIndex.pop_back();
+        while (entryIndex.size() > maximumEntries)
+            removeOldestEntry();
+    }
+
+    if (entryIndex.size() == startingEntries) return;
+    releaseUnusedObjects();
+    compactPacks();
+}
+
+void Clipboard::deduplicateCurrentEntry() {
+    if (!fs::exists(data)) return;
+    for (const auto& entry : fs::recursive_directory_iterator(data)) {
+        if (!entry.is_regular_file() || entry.is_symlink() || entry.file_size() == 0) continue;
+        // a file that's already linked elsewhere is either stored already or is a --fast-copy link to the user's own file, so leave it alone
+        if (entry.hard_link_count() > 1) continue;
+        // hidden and tagged with our PID, like the pack table's temporary, so it can't collide with a real item
+        auto temporary = entry.path().parent_path() / ("." + entry.path().filename().string() + "." + std::to_string(thisPID()) + ".object");
+        bool linkedTemporary = false;
+        try {
+            fs::create_directories(objects);
+            auto object = objects / sha256Of(entry.path());
+            if (!fs::exists(object)) {
+                fs::create_hard_link(entry.path(), object);
+                continue;
+            }
+            // swap in a link to the existing object atomically so the entry never goes missing
+            fs::create_hard_link(object, temporary);
+            linkedTemporary = true;
+            fs::rename(temporary, entry.path());
+        } catch (const fs::filesystem_error& e) {
+            std::error_code ec;
+            if (linkedTemporary) fs::remove(temporary, ec); // a leftover link would get pasted as if it were an item
+            // this filesystem doesn't support hard links, so keep everything as a regular copy
+            if (auto code = e.code(); code == std::errc::cross_device_link || code == std::errc::operation_not_permitted || code == std::errc::too_many_links
+                                      || code == std::errc::operation_not_supported || code == std::errc::function_not_supported)
+                return;
+            continue; // otherwise just this file stays a regular copy
         }
     }
+}
+
+void Clipboard::releaseUnusedObjects() {
+    if (!fs::exists(objects)) return;
+    std::error_code ec;
+    for (const auto& object : fs::directory_iterator(objects))
+        if (!object.is_directory(ec) && object.hard_link_count(ec) <= 1 && !ec) fs::remove(object.path(), ec); // no more entries refer to this object
+    // whatever this entry used to be chunked into isn't needed by it anymore
+    if (!isChunkedFile(data.raw)) releaseChunksOf(entryIndex.at(this_entry));
 }
\ No newline at end of file
@@ -23,10 +23,15 @@
 #include <deque>
 #include <filesystem>
 #include <functional>
+#include <limits>
+#include <map>
+#include <memory>
 #include <mutex>
 #include <regex>
 #include <string_view>
 #include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include <valarray>
 #include <vector>
 
@@ -87,10 +92,27 @@ struct Constants {
     std::string_view mime_name = "mime";
     std::string_view lock_name = "lock";
     std::string_view data_directory = "data";
+    std::string_view objects_directory = "objects";
+    std::string_view chunks_directory = "chunks";
+    std::string_view chunk_references_directory = "references";
+    size_t chunking_threshold = 8 * 1024 * 1024;
     std::string_view metadata_directory = "metadata";
     std::string_view import_export_directory = "Exported_Clipboards";
     std::string_view ignore_regex_name = "ignore";
     std::string_view ignore_secret_name = "ignore.secret";
+    std::string_view entry_index_name = "index";
+    std::string_view packs_directory = "packs";
+    std::string_view pack_table_name = "table";
+    std::string_view pack_extension = ".pack";
+    size_t pack_segment_size = 8 * 1024 * 1024;
+    size_t piped_head_size = 1024 * 1024;
+    size_t file_mapping_threshold = 64 * 1024;
+    size_t preview_head_size = 4096;
+    std::string_view search_index_name = "search";
+    std::string_view search_additions_name = "search.new";
+    size_t search_index_limit = 1024 * 1024; // entries bigger than this always get searched in full
+    size_t search_contents_limit = 16 * 1024 * 1024; // stored files bigger than this only get searched by name, even with --contents
+    size_t literal_automaton_minimum = 32; // below this many literals, scanning for each one on its own with findLiteral() is faster
 };
 constexpr Constants constants;
 
@@ -107,6 +129,47 @@ struct Copying {
 };
 extern Copying copying;
 
+enum class CopyMethod { Reflink, CopyFileRange, ReadWrite };
+
+std::string_view copyMethodName(const CopyMethod& method);
+CopyMethod copyFile(const fs::path& from, const fs::path& to);
+void copyPath(const fs::path& from, const fs::path& to, const fs::copy_options& options = copying.opts);
+
+// Copies files and whole trees with a pool of threads that steal work from each other, so that many small files don't have to wait on each other
+class CopyEngine {
+    struct Task {
+        fs::path from;
+        fs::path to;
+        size_t item = 0;
+    };
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+    fs::copy_options options;
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> threads;
+    std::mutex sleepMutex;
+    std::condition_variable wakeUp;
+    std::condition_variable finished;
+    std::atomic<size_t> queuedTasks = 0;
+    std::atomic<size_t> pendingTasks = 0;
+    bool stopping = false;
+    std::mutex errorsMutex;
+    std::vector<std::error_code> errors;
+
+    void push(Task&& task, const size_t& queue);
+    std::optional<Task> take(const size_t& queue);
+    void work(const size_t queue);
+    void fail(const size_t& item, const std::error_code& error);
+
+public:
+    explicit CopyEngine(const fs::copy_options& options = copying.opts);
+    ~CopyEngine();
+    void add(const fs::path& from, const fs::path& to);
+    std::vector<std::error_code> wait(); // one error code for every item in the order they were added, empty if that item was copied
+};
+
 std::vector<std::string> regexSplit(const std::string& content, const std::regex& regex);
 
 bool isPersistent(const auto& clipboard) {
@@ -149,8 +212,75 @@ static size_t totalDirectorySize(const fs::path& directory) {
     return size;
 }
 
+// Finds where each of a set of literals first shows up in one pass over the content, however many literals there are
+class LiteralAutomaton {
+    std::array<uint16_t, 256> classOf {}; // bytes that aren't in any literal all share class 0, which keeps the table small
+    size_t classes = 1;
+    std::vector<uint32_t> next; // where each state's row starts for each byte class, with the top bit set if any literal ends there
+    std::vector<uint32_t> endingStart; // which literals end at each state, counting ones that are suffixes of it, as ranges in ending
+    std::vector<uint32_t> ending;
+    std::vector<size_t> lengths;
+
+public:
+    explicit LiteralAutomaton(const std::vector<std::string>& literals);
+    std::vector<size_t> firstPositions(const std::string_view& content) const;
+};
+
+// How well a query fuzzily matches some content out of 1000, and where each of the query's characters is in it
+struct FuzzyMatch {
+    unsigned long score = 0;
+    std::vector<size_t> positions;
+};
+
+// A read-only look at a file's content that memory-maps big files instead of copying them, and decodes compressed or chunked raw data
+class FileView {
+    std::string owned;
+    void* mapping = nullptr;
+    size_t mappingLength = 0;
+    std::string_view view;
+    bool found = false;
+    void release();
+
+public:
+    FileView() = default;
+    explicit FileView(const fs::path& path);
+    explicit FileView(std::string&& content);
+    FileView(FileView&& other) noexcept;
+    FileView& operator=(FileView&& other) noexcept;
+    FileView(const FileView&) = delete;
+    FileView& operator=(const FileView&) = delete;
+    ~FileView();
+    explicit operator bool() const { return found; }
+    std::string_view content() const { return view; }
+    const char* data() const { return view.data(); }
+    size_t size() const { return view.size(); }
+    std::string string() &&;
+};
+
+// What a single stat and a read of the start of a file turned up, from probeFiles()
+struct FileProbe {
+    bool exists = false;
+    bool isDirectory = false;
+    uint64_t size = 0;
+    int64_t time = 0; // last write time as ticks of fs::file_time_type
+    std::string head;
+};
+
+std::vector<FileProbe> probeFiles(const std::vector<fs::path>& paths, const size_t& headSize);
 std::optional<std::string> fileContents(const fs::path& path);
 std::vector<std::string> fileLines(const fs::path& path);
+void streamFileContents(const fs::path& path, const std::function<bool(const std::string_view&)>& sink);
+std::string fileHead(const fs::path& path, const size_t& length);
+uintmax_t originalFileSize(const fs::path& path);
+uintmax_t storedFileSize(const fs::path& path);
+bool isEncodedFile(const fs::path& path);
+bool isChunkedFile(const fs::path& path);
+bool isEncodedContent(const std::string_view& content);
+std::string escapeHeaderFor(const std::string_view& head); // what has to go in front of plain raw data that starts like encoded content
+void escapeFile(const fs::path& path);
+bool compressFile(const fs::path& path);
+void decodeFile(const fs::path& path, const bool& keepEscaped = true);
+std::string decodedContents(const fs::path& path, const std::string_view& content);
 
 bool stopIndicator(bool change_condition_variable = true);
 
@@ -160,6 +290,8 @@ void deduplicate(auto& items) {
 }
 
 size_t writeToFile(const fs::path& path, const std::string& content, bool append = false);
+void unshareFile(const fs::path& path);
+std::string sha256Of(const fs::path& file);
 
 extern std::vector<std::string> arguments;
 
@@ -178,7 +310,12 @@ extern bool progress_silent;
 extern bool confirmation_silent;
 extern bool no_color;
 extern bool all_option;
+extern bool contents_option;
 extern bool secret_selection;
+extern size_t limit_option;
+extern size_t offset_option;
+extern std::optional<std::chrono::seconds> since_option;
+extern std::optional<std::chrono::seconds> until_option;
 
 extern std::string preferred_mime;
 extern std::vector<std::string> available_mimes;
@@ -257,6 +394,57 @@ public:
 std::string JSONescape(const std::string_view& input);
 std::string formatColors(const std::string_view& str, bool colorful = !no_color);
 
+enum class EntryContent : uint8_t { Nothing, RawData, Items };
+
+struct EntryRecord {
+    unsigned long entry = 0;
+    int64_t time = 0; // last write time of the entry as ticks of fs::file_time_type
+    int64_t contentTime = 0; // when the content itself last changed, to notice when this record is out of date
+    uint64_t bytes = 0;
+    uint64_t storedBytes = 0; // what the entry takes up in the clipboard, which is what the history size limit goes by
+    uint32_t items = 0;
+    uint32_t files = 0;
+    uint32_t directories = 0;
+    EntryContent content = EntryContent::Nothing;
+    bool hashed = false;
+    std::array<unsigned char, 32> sha256 {}; // of the raw data, only filled in when the entry was written
+    std::array<char, 64> mime {};
+    uint16_t previewLength = 0;
+    std::array<char, 256> preview {}; // the start of the raw data, or the names of the items separated by \0 with a / after directories
+
+    void setPreview(const std::string_view& content);
+    std::string_view previewText() const { return {preview.data(), previewLength}; }
+    std::string_view mimeType() const { return {mime.data(), static_cast<size_t>(std::find(mime.begin(), mime.end(), '\0') - mime.begin())}; }
+    std::vector<std::pair<std::string_view, bool>> itemNames() const;
+    std::string hashText() const;
+    fs::file_time_type lastWriteTime() const { return fs::file_time_type(fs::file_time_type::duration(time)); }
+};
+
+// An entry as the search index saw it: which three-byte sequences (trigrams) its content has, packed into the low 24 bits
+struct IndexedEntry {
+    int64_t contentTime = 0; // the entry's record's contentTime when it was indexed, to notice when the index is out of date
+    bool complete = true; // too-big entries aren't indexed and always need searching
+    std::vector<uint32_t> trigrams; // sorted
+};
+
+struct SearchIndex {
+    FileView merged; // the bulk of the index, mapped into memory
+    std::map<unsigned long, IndexedEntry> additions; // entries indexed since the merged index was last written
+    bool changed = false;
+};
+
+std::vector<uint32_t> trigramsOf(const std::string_view& content);
+IndexedEntry indexedContent(const std::string_view& content);
+
+struct PackedEntry {
+    uint64_t entry = 0;
+    uint32_t segment = 0;
+    uint32_t reserved = 0;
+    uint64_t offset = 0; // where the content starts in the segment, right after its header
+    uint64_t length = 0;
+    int64_t time = 0;
+};
+
 class Clipboard {
     fs::path root;
     std::string this_name;
@@ -287,13 +475,43 @@ public:
         fs::path lock;
         fs::path ignore;
         fs::path ignore_secret;
+        fs::path index;
+        fs::path search_index;
+        fs::path search_additions;
         operator fs::path() { return root; }
         operator fs::path() const { return root; }
         auto operator=(const auto& other) { return root = other; }
         auto operator/(const auto& other) { return root / other; }
     } metadata;
 
+    fs::path objects;
+
+    std::unordered_map<unsigned long, EntryRecord> entryRecords;
+    uint64_t recordedBytes = 0; // running total of storedBytes across entryRecords
+    std::unordered_set<unsigned long> checkedEntries; // entries whose records were just checked against the disk
+    int64_t indexedDataTime = -1;
+    bool entryRecordsChanged = false;
+
+    fs::path packs;
+    std::optional<std::unordered_map<unsigned long, PackedEntry>> packTable;
+    bool packTableChanged = false;
+
+    std::shared_ptr<SearchIndex> loadedSearchIndex;
+
+    std::unordered_map<unsigned long, PackedEntry>& packedEntries();
+    std::optional<PackedEntry> packedEntryFor(const unsigned long& entryNumber);
+    std::string packedContents(const PackedEntry& packed, const size_t& limit = std::string::npos);
+    PackedEntry appendToPack(const unsigned long& entryNumber, const int64_t& time, const std::string& content, const uint32_t& minimumSegment = 0);
+    void unpackEntry(const unsigned long& entryNumber);
+    void savePackTable();
+
     std::deque<unsigned long> generatedEntryIndex();
+    std::deque<unsigned long> scannedEntryIndex();
+    bool loadEntryIndex();
+    EntryRecord generatedEntryRecord(const unsigned long& entryNumber, const bool& hashContent = false);
+    const EntryRecord& storeEntryRecord(EntryRecord&& record);
+    void forgetEntryRecord(const unsigned long& entryNumber);
+    uint64_t totalStoredBytes();
 
     Clipboard() = default;
     Clipboard(const std::string& clipboard_name, const unsigned long& clipboard_entry = constants.default_clipboard_entry);
@@ -302,7 +520,7 @@ public:
     auto operator=(const auto& other) { return root = other; }
     auto operator/(const auto& other) { return root / other; }
     std::string string() { return root.string(); }
-    bool holdsRawDataInCurrentEntry() const;
+    bool holdsRawDataInCurrentEntry();
     bool holdsDataInCurrentEntry();
     bool holdsIgnoreRegexes();
     bool holdsIgnoreSecrets();
@@ -319,9 +537,36 @@ public:
     void makeNewEntry();
     void setEntry(const unsigned long& entry);
     fs::path entryPathFor(const unsigned long& entry);
+    bool isPacked(const unsigned long& entry) { return packedEntryFor(entryIndex.at(entry)).has_value(); }
     bool holdsData();
     void trimHistoryEntries();
+    bool compressesContent();
+    void compressCurrentEntry();
+    void chunkCurrentEntry();
+    void releaseChunksOf(const unsigned long& entryNumber);
+    void moveChunkReferences(const unsigned long& from, const unsigned long& to);
+    void deduplicateCurrentEntry();
+    void releaseUnusedObjects();
+    const EntryRecord& recordFor(const unsigned long& entry);
+    const EntryRecord& freshRecordFor(const unsigned long& entry);
+    void prefetchEntryRecords(const std::vector<unsigned long>& entries);
+    void updateEntryRecord();
+    void saveEntryIndex();
+    FileView rawDataFor(const unsigned long& entry);
+    size_t removeOldestEntry();
+    void packEntries();
+    void compactPacks();
+    SearchIndex& searchIndex();
+    bool isIndexedForSearch(const unsigned long& entry);
+    void indexForSearch(const unsigned long& entry);
+    void indexForSearch(const unsigned long& entry, const std::string_view& content);
+    void indexForSearch(const unsigned long& entry, IndexedEntry&& indexed);
+    std::vector<unsigned long> entriesPossiblyContaining(const std::vector<std::string>& literals);
+    void saveSearchIndex();
 };
+
+void prefetchEntryRecords(const std::vector<std::pair<Clipboard*, unsigned long>>& wanted);
+
 extern Clipboard path;
 
 void incrementSuccessesForItem(const auto& item) {
@@ -363,7 +608,11 @@ size_t columnLength(const std::string_view& message);
 std::string generatedEndbar();
 std::string repeatString(const std::string_view& character, const size_t& length);
 std::string makeControlCharactersVisible(const std::string_view& oldStr, size_t len = 0);
-unsigned long levenshteinDistance(const std::string_view& one, const std::string_view& two);
+size_t findLiteral(const std::string_view& haystack, const std::string_view& needle);
+std::string_view literalScanner();
+std::optional<FuzzyMatch> fuzzyMatch(const std::string_view& content, const std::string_view& query);
+unsigned long levenshteinDistance(const std::string_view& one, const std::string_view& two, const unsigned long& maxDistance = std::numeric_limits<unsigned long>::max());
+std::optional<std::chrono::seconds> parsedDuration(const std::string_view& duration);
 void setLanguagePT();
 void setLanguageTR();
 void setLanguageES_CO();
@@ -413,6 +662,7 @@ void clearClipboard();
 void performAction();
 void updateExternalClipboards(bool force = false);
 std::string pipedInContent(bool count = true);
+std::string pipeInToFile(const fs::path& path);
 void showFailures();
 void showSuccesses();
 [[nodiscard]] CopyPolicy userDecision(const std::string& item);
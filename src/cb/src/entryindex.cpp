@@ -0,0 +1,324 @@
+/*  The Clipboard Project - Cut, copy, and paste anything, anytime, anywhere, all from the terminal.
+    Copyright (C) 2023 Jackson Huff and other contributors on GitHub.com
+    SPDX-License-Identifier: GPL-3.0-or-later
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.*/
+#include "clipboard.hpp"
+#include <openssl/evp.h>
+
+// The entry index is a cache of everything history and status need to know about each entry, so that they don't have to stat and read every entry.
+// It's a header followed by fixed-size records, newest entry first, and it's valid as long as the data directory hasn't changed since it was written.
+
+struct EntryIndexHeader {
+    std::array<char, 8> magic {'C', 'B', 'I', 'N', 'D', 'E', 'X', '\0'};
+    uint32_t version = 3;
+    uint32_t recordSize = sizeof(EntryRecord);
+    uint64_t records = 0;
+    int64_t dataTime = 0;
+};
+
+static int64_t lastWriteTicks(const fs::path& path) {
+    std::error_code ec;
+    auto time = fs::last_write_time(path, ec);
+    if (ec) return 0;
+    return time.time_since_epoch().count();
+}
+
+static int64_t contentTicks(const fs::path& entryPath) {
+    // rewriting the raw data in place doesn't touch the entry's directory, so look at both
+    std::error_code ec;
+    auto raw = fs::last_write_time(entryPath / constants.data_file_name, ec);
+    if (ec) return lastWriteTicks(entryPath);
+    return std::max(lastWriteTicks(entryPath), raw.time_since_epoch().count());
+}
+
+static int64_t readEntryIndex(const fs::path& file, const auto& recordHandler) {
+    EntryIndexHeader expected;
+    auto parse = [&](const char* bytes, size_t size) -> int64_t {
+        EntryIndexHeader header;
+        if (size < sizeof(header)) return -1;
+        std::memcpy(&header, bytes, sizeof(header));
+        if (header.magic != expected.magic || header.version != expected.version || header.recordSize != expected.recordSize) return -1;
+        if (size < sizeof(header) + header.records * sizeof(EntryRecord)) return -1;
+        EntryRecord record;
+        for (uint64_t i = 0; i < header.records; i++) {
+            std::memcpy(&record, bytes + sizeof(header) + i * sizeof(EntryRecord), sizeof(EntryRecord));
+            recordHandler(record);
+        }
+        return header.dataTime;
+    };
+    try {
+        FileView content(file); // big histories get mapped into memory instead of copied
+        if (!content) return -1;
+        return parse(content.data(), content.size());
+    } catch (const std::exception& e) {
+        return -1;
+    }
+}
+
+bool Clipboard::loadEntryIndex() {
+    entryRecords.clear();
+    recordedBytes = 0;
+    indexedDataTime = readEntryIndex(metadata.index, [&](const EntryRecord& record) {
+        entryRecords.insert_or_assign(record.entry, record);
+        recordedBytes += record.storedBytes;
+    });
+    if (indexedDataTime == -1) {
+        entryRecords.clear();
+        recordedBytes = 0;
+    }
+    return indexedDataTime != -1 && indexedDataTime == lastWriteTicks(root / constants.data_directory);
+}
+
+// only the start of the content is needed to tell what it is and show a preview, so don't read all of it
+static void describeRawData(EntryRecord& record, const std::string& head) {
+    record.content = EntryContent::RawData;
+    auto type = inferMIMEType(head).value_or("");
+    std::copy_n(type.begin(), std::min(type.size(), record.mime.size() - 1), record.mime.begin());
+    record.setPreview(head);
+}
+
+EntryRecord Clipboard::generatedEntryRecord(const unsigned long& entryNumber, const bool& hashContent) {
+    EntryRecord record;
+    record.entry = entryNumber;
+    auto entryPath = root / constants.data_directory / std::to_string(entryNumber);
+
+    // hashing means reading everything, so only do it when the entry is written and not when an old record is rebuilt
+    auto hashRawData = [&](const auto& feed) {
+        auto context = EVP_MD_CTX_new();
+        EVP_DigestInit_ex(context, EVP_sha256(), nullptr);
+        feed([&](const std::string_view& content) { return EVP_DigestUpdate(context, content.data(), content.size()) == 1; });
+        EVP_DigestFinal_ex(context, record.sha256.data(), nullptr);
+        EVP_MD_CTX_free(context);
+        record.hashed = true;
+    };
+
+    if (auto packed = packedEntryFor(entryNumber)) {
+        record.time = packed->time;
+        record.contentTime = packed->time;
+        record.bytes = packed->length;
+        record.storedBytes = packed->length;
+        if (packed->length == 0) return record;
+        auto head = packedContents(packed.value(), constants.preview_head_size);
+        std::optional<std::string> decoded;
+        if (isEncodedContent(head)) { // packs keep content the way it was stored, so compressed content has to be decoded to tell what it is
+            decoded = decodedContents(entryPath / constants.data_file_name, packedContents(packed.value()));
+            record.bytes = decoded->size();
+            head = decoded->substr(0, constants.preview_head_size);
+        }
+        describeRawData(record, head);
+        if (hashContent) hashRawData([&](const auto& sink) { sink(decoded ? decoded.value() : packedContents(packed.value())); });
+        return record;
+    }
+
+    record.time = lastWriteTicks(entryPath);
+    record.contentTime = contentTicks(entryPath);
+
+    std::error_code ec;
+    if (fs::is_empty(entryPath, ec) || ec) return record;
+
+    if (auto size = fs::file_size(entryPath / constants.data_file_name, ec); !ec && size > 0) {
+        record.bytes = originalFileSize(entryPath / constants.data_file_name);
+        record.storedBytes = storedFileSize(entryPath / constants.data_file_name);
+        describeRawData(record, fileHead(entryPath / constants.data_file_name, constants.preview_head_size));
+        if (hashContent) hashRawData([&](const auto& sink) { streamFileContents(entryPath / constants.data_file_name, sink); });
+        return record;
+    }
+
+    std::string names;
+    bool holdsData = false;
+    for (const auto& item : fs::directory_iterator(entryPath)) {
+        auto filename = item.path().filename().string();
+        if (filename == constants.data_file_name && item.file_size() == 0) continue;
+        record.items++;
+        if (item.is_directory()) {
+            record.directories++;
+            record.bytes += totalDirectorySize(item.path());
+            filename += "/";
+        } else {
+            record.files++;
+            record.bytes += item.file_size();
+        }
+        if (!fs::is_empty(item.path())) holdsData = true;
+        if (names.size() + filename.size() + 1 <= record.preview.size()) names.append(filename).append(1, '\0');
+    }
+    record.setPreview(names);
+    record.storedBytes = record.bytes;
+    if (holdsData) record.content = EntryContent::Items;
+    return record;
+}
+
+void EntryRecord::setPreview(const std::string_view& content) {
+    auto length = std::min(content.size(), preview.size());
+    if (content.size() > preview.size())
+        while (length > 0 && (content[length] & 0xC0) == 0x80) // don't cut a UTF-8 character in half
+            length--;
+    preview.fill('\0');
+    std::copy_n(content.begin(), length, preview.begin());
+    previewLength = length;
+}
+
+std::vector<std::pair<std::string_view, bool>> EntryRecord::itemNames() const {
+    std::vector<std::pair<std::string_view, bool>> names;
+    auto remaining = previewText();
+    while (!remaining.empty()) {
+        auto end = remaining.find('\0');
+        auto name = remaining.substr(0, end);
+        if (name.ends_with('/'))
+            names.emplace_back(name.substr(0, name.size() - 1), true);
+        else
+            names.emplace_back(name, false);
+        if (end == std::string_view::npos) break;
+        remaining.remove_prefix(end + 1);
+    }
+    return names;
+}
+
+std::string EntryRecord::hashText() const {
+    if (!hashed) return {};
+    std::stringstream ss;
+    for (const auto& byte : sha256)
+        ss << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(byte);
+    return ss.str();
+}
+
+const EntryRecord& Clipboard::storeEntryRecord(EntryRecord&& record) {
+    forgetEntryRecord(record.entry);
+    recordedBytes += record.storedBytes;
+    entryRecordsChanged = true;
+    return entryRecords.insert_or_assign(record.entry, std::move(record)).first->second;
+}
+
+void Clipboard::forgetEntryRecord(const unsigned long& entryNumber) {
+    auto record = entryRecords.find(entryNumber);
+    if (record == entryRecords.end()) return;
+    recordedBytes -= std::min(record->second.storedBytes, recordedBytes);
+    entryRecords.erase(record);
+    checkedEntries.erase(entryNumber);
+    entryRecordsChanged = true;
+}
+
+uint64_t Clipboard::totalStoredBytes() {
+    // records only go missing or linger when another process changed the history, so usually this is just the running total
+    if (entryRecords.size() != entryIndex.size() || !entryRecords.contains(entryIndex.front())) {
+        std::vector<unsigned long> stale;
+        for (const auto& [entryNumber, record] : entryRecords)
+            if (!std::binary_search(entryIndex.begin(), entryIndex.end(), entryNumber, std::greater<>())) stale.emplace_back(entryNumber);
+        for (const auto& entryNumber : stale)
+            forgetEntryRecord(entryNumber);
+        for (unsigned long entry = 0; entry < entryIndex.size(); entry++)
+            recordFor(entry);
+    }
+    return recordedBytes;
+}
+
+const EntryRecord& Clipboard::recordFor(const unsigned long& entry) {
+    auto entryNumber = entryIndex.at(entry);
+    if (auto record = entryRecords.find(entryNumber); record != entryRecords.end()) return record->second;
+    return storeEntryRecord(generatedEntryRecord(entryNumber));
+}
+
+const EntryRecord& Clipboard::freshRecordFor(const unsigned long& entry) {
+    const auto& record = recordFor(entry);
+    if (checkedEntries.contains(entryIndex.at(entry))) return record;
+    if (packedEntryFor(entryIndex.at(entry))) return record; // packed entries never change
+    if (record.contentTime == contentTicks(root / constants.data_directory / std::to_string(entryIndex.at(entry)))) return record;
+    // something changed this entry behind our back, so look at it again
+    return storeEntryRecord(generatedEntryRecord(entryIndex.at(entry)));
+}
+
+void prefetchEntryRecords(const std::vector<std::pair<Clipboard*, unsigned long>>& wanted) {
+    // look at every entry's directory and raw data in one go, then only fall back to one at a time for entries with items or encoded raw data
+    std::vector<std::pair<Clipboard*, unsigned long>> entries;
+    std::vector<fs::path> paths;
+    for (const auto& [clipboard, entry] : wanted) {
+        auto entryNumber = clipboard->entryIndex.at(entry);
+        if (clipboard->checkedEntries.contains(entryNumber) || clipboard->packedEntryFor(entryNumber)) continue;
+        auto entryPath = static_cast<fs::path>(*clipboard) / constants.data_directory / std::to_string(entryNumber);
+        entries.emplace_back(clipboard, entryNumber);
+        paths.emplace_back(entryPath);
+        paths.emplace_back(entryPath / constants.data_file_name);
+    }
+    if (entries.empty()) return;
+
+    auto probes = probeFiles(paths, constants.preview_head_size);
+    for (size_t index = 0; index < entries.size(); index++) {
+        auto& [clipboard, entryNumber] = entries[index];
+        const auto& directory = probes[index * 2];
+        const auto& raw = probes[index * 2 + 1];
+        if (!directory.exists) continue;
+        auto contentTime = raw.exists ? std::max(directory.time, raw.time) : directory.time;
+        if (auto record = clipboard->entryRecords.find(entryNumber); record != clipboard->entryRecords.end() && record->second.contentTime == contentTime) {
+            clipboard->checkedEntries.insert(entryNumber);
+            continue;
+        }
+        if (!raw.exists || raw.size == 0 || isEncodedContent(raw.head)) continue;
+        EntryRecord record;
+        record.entry = entryNumber;
+        record.time = directory.time;
+        record.contentTime = contentTime;
+        record.bytes = raw.size;
+        record.storedBytes = raw.size;
+        describeRawData(record, raw.head);
+        clipboard->storeEntryRecord(std::move(record));
+        clipboard->checkedEntries.insert(entryNumber);
+    }
+}
+
+void Clipboard::prefetchEntryRecords(const std::vector<unsigned long>& entries) {
+    std::vector<std::pair<Clipboard*, unsigned long>> wanted;
+    for (const auto& entry : entries)
+        wanted.emplace_back(this, entry);
+    ::prefetchEntryRecords(wanted);
+}
+
+void Clipboard::updateEntryRecord() {
+    storeEntryRecord(generatedEntryRecord(entryIndex.at(this_entry), true));
+}
+
+void Clipboard::saveEntryIndex() {
+    auto dataTime = lastWriteTicks(root / constants.data_directory);
+    if (!entryRecordsChanged && dataTime == indexedDataTime) return;
+
+    if (dataTime != indexedDataTime) { // entries were added, moved, or removed, so check what's actually there
+        entryIndex = scannedEntryIndex();
+        std::erase_if(entryRecords, [&](const auto& record) {
+            if (std::binary_search(entryIndex.begin(), entryIndex.end(), record.first, std::greater<>())) return false;
+            recordedBytes -= std::min(record.second.storedBytes, recordedBytes);
+            return true;
+        });
+    }
+
+    EntryIndexHeader header;
+    header.records = entryIndex.size();
+    header.dataTime = dataTime;
+
+    std::string buffer;
+    buffer.reserve(sizeof(header) + entryIndex.size() * sizeof(EntryRecord));
+    buffer.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (unsigned long entry = 0; entry < entryIndex.size(); entry++)
+        buffer.append(reinterpret_cast<const char*>(&recordFor(entry)), sizeof(EntryRecord));
+
+    // write everything to a separate file first and then swap it in, so that nobody ever sees half of an index
+    auto temporary = metadata.index;
+    temporary += "." + std::to_string(thisPID());
+    try {
+        fs::create_directories(metadata);
+        writeToFile(temporary, buffer);
+        fs::rename(temporary, metadata.index);
+        indexedDataTime = dataTime;
+        entryRecordsChanged = false;
+    } catch (const fs::filesystem_error& e) {
+        fs::remove(temporary);
+    }
+}
@@ -109,7 +109,7 @@ ClipboardContent getRemoteClipboard() {
 }
 
 void convertFromGUIClipboard(const std::string& text) {
-    if (fs::exists(path.data.raw) && (fileContents(path.data.raw).value() == text || text.size() == 4096 && fileContents(path.data.raw).value().size() > 4096))
+    if (FileView current(path.data.raw); current && (current.content() == text || text.size() == 4096 && current.size() > 4096))
         return; // check if 4096b long because remote clipboard is up to 4096b long
     auto regexes = path.ignoreRegexes();
     for (const auto& regex : regexes)
@@ -125,6 +125,10 @@ void convertFromGUIClipboard(const std::string& text) {
     }
     path.makeNewEntry();
     writeToFile(path.data.raw, text);
+    path.chunkCurrentEntry();
+    path.compressCurrentEntry();
+    path.deduplicateCurrentEntry();
+    path.updateEntryRecord();
 }
 
 void convertFromGUIClipboard(const ClipboardPaths& clipboard) {
@@ -145,7 +149,7 @@ void convertFromGUIClipboard(const ClipboardPaths& clipboard) {
         if (!fs::is_directory(path) && fs::file_size(path) != fs::file_size(::path.data / filename)) return true;
 
         // check if the file contents are different if it's not a directory
-        if (!fs::is_directory(path) && fileContents(path).value() != fileContents(::path.data / filename)) return true;
+        if (!fs::is_directory(path) && FileView(path).content() != FileView(::path.data / filename).content()) return true;
 
         return false;
     });
@@ -165,12 +169,9 @@ void convertFromGUIClipboard(const ClipboardPaths& clipboard) {
         if (fs::exists(target) && fs::equivalent(path, target)) continue;
 
         try {
-            fs::copy(path, target, copying.opts | fs::copy_options::create_hard_links);
-        } catch (const fs::filesystem_error& e) {
-            try {
-                fs::copy(path, target, copying.opts);
-            } catch (const fs::filesystem_error& e) {} // Give up
-        }
+            unshareFile(target); // copies write over existing files in place, and other entries might share this one's content
+            copyPath(path, target);
+        } catch (const fs::filesystem_error& e) {} // Give up
     }
 
     if (clipboard.action() == ClipboardPathsAction::Cut) {
@@ -193,7 +194,11 @@ ClipboardContent thisClipboard() {
 
     if (!copying.buffer.empty()) return {copying.buffer, copying.mime};
 
-    if (default_cb.holdsRawDataInCurrentEntry()) return {fileContents(default_cb.data.raw).value(), std::string(inferMIMEType(fileContents(default_cb.data.raw).value()).value_or("text/plain"))};
+    if (default_cb.holdsRawDataInCurrentEntry()) {
+        auto type = std::string(default_cb.freshRecordFor(default_cb.entry()).mimeType());
+        if (type.empty()) type = "text/plain";
+        return {FileView(default_cb.data.raw).string(), type};
+    }
 
     if (!copying.items.empty()) {
         std::vector<fs::path> paths;
@@ -105,7 +105,8 @@ void indicatorThread() {
     }
 
     auto itemsToProcess = [&] {
-        return std::distance(fs::directory_iterator(path.data), fs::directory_iterator());
+        std::error_code ec; // packed entries don't have a directory
+        return std::distance(fs::directory_iterator(path.data, ec), fs::directory_iterator());
     };
 
     static size_t items_size = action_is_one_of(Action::Cut, Action::Copy) ? copying.items.size() : itemsToProcess();
@@ -62,6 +62,8 @@ int main(int argc, char* argv[]) {
 
         if (needsANewEntry()) path.makeNewEntry();
 
+        if (isAWriteAction()) path.unpackEntry(path.entryIndex.at(path.entry())); // everything else reads packed entries right from their pack
+
         (clipboard_state.exchange(ClipboardState::Action), cv.notify_one());
 
         (fs::create_directories(global_path.temporary), fs::create_directories(global_path.persistent));
@@ -74,6 +76,16 @@ int main(int argc, char* argv[]) {
 
         if (isAWriteAction()) path.applyIgnoreRules();
 
+        if (isAWriteAction()) path.chunkCurrentEntry();
+
+        if (isAWriteAction()) path.compressCurrentEntry();
+
+        if (isAWriteAction()) path.deduplicateCurrentEntry();
+
+        if (isAWriteAction()) path.updateEntryRecord();
+
+        if (isAWriteAction()) path.indexForSearch(path.entry());
+
         copying.mime = getMIMEType();
 
         updateExternalClipboards();
@@ -89,6 +101,12 @@ int main(int argc, char* argv[]) {
         showSuccesses();
 
         path.trimHistoryEntries();
+
+        path.packEntries();
+
+        path.saveEntryIndex();
+
+        path.saveSearchIndex();
     } catch (const std::exception& e) {
         clipboard_state = ClipboardState::Error;
         stopIndicator();
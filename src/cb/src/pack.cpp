@@ -0,0 +1,275 @@
+/*  The Clipboard Project - Cut, copy, and paste anything, anytime, anywhere, all from the terminal.
+    Copyright (C) 2023 Jackson Huff and other contributors on GitHub.com
+    SPDX-License-Identifier: GPL-3.0-or-later
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.*/
+#include "clipboard.hpp"
+#include <fstream>
+
+// Packed entries live in append-only segment files instead of a directory each, which saves an inode and several syscalls per entry.
+// Every packed entry is a header followed by its content, and the table maps entry numbers to where their content is.
+// Anything in a segment that the table doesn't point to anymore is dead and gets dropped when that segment is compacted.
+
+struct PackHeader {
+    uint64_t entry = 0;
+    int64_t time = 0;
+    uint64_t length = 0;
+};
+
+struct PackTableHeader {
+    std::array<char, 8> magic {'C', 'B', 'P', 'A', 'C', 'K', 'S', '\0'};
+    uint32_t version = 1;
+    uint32_t recordSize = sizeof(PackedEntry);
+    uint64_t records = 0;
+};
+
+static fs::path segmentPath(const fs::path& packs, const uint32_t& segment) {
+    return packs / (std::to_string(segment) + std::string(constants.pack_extension));
+}
+
+// packs are the only copy of what's in them, so anything written to one has to be on disk before an entry directory or table record goes away
+static void writeDurably(const fs::path& path, const std::string& content, const bool& append = false) {
+#if defined(_WIN32) || defined(_WIN64)
+    auto fail = [&] { throw fs::filesystem_error("Couldn't write", path, std::error_code(GetLastError(), std::system_category())); };
+    HANDLE file = CreateFileW(path.c_str(), append ? FILE_APPEND_DATA : GENERIC_WRITE, 0, NULL, append ? OPEN_ALWAYS : CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) fail();
+    DWORD written = 0;
+    bool succeeded = WriteFile(file, content.data(), static_cast<DWORD>(content.size()), &written, NULL) && written == content.size() && FlushFileBuffers(file);
+    CloseHandle(file);
+    if (!succeeded) fail();
+#else
+    auto fail = [&] { throw fs::filesystem_error("Couldn't write", path, std::error_code(errno, std::generic_category())); };
+    int fd = open(path.string().data(), O_WRONLY | O_CREAT | O_CLOEXEC | (append ? O_APPEND : O_TRUNC), 0644);
+    if (fd == -1) fail();
+    for (size_t written = 0; written < content.size();) {
+        auto result = write(fd, content.data() + written, content.size() - written);
+        if (result == -1 && errno == EINTR) continue;
+        if (result == -1) {
+            close(fd);
+            fail();
+        }
+        written += result;
+    }
+    if (fsync(fd) == -1) {
+        close(fd);
+        fail();
+    }
+    close(fd);
+#endif
+}
+
+std::unordered_map<unsigned long, PackedEntry>& Clipboard::packedEntries() {
+    if (packTable) return packTable.value();
+    packTable.emplace();
+    FileView content(packs / constants.pack_table_name);
+    if (!content) return packTable.value();
+    PackTableHeader expected, header;
+    if (content.size() < sizeof(header)) return packTable.value();
+    std::memcpy(&header, content.data(), sizeof(header));
+    if (header.magic != expected.magic || header.version != expected.version || header.recordSize != expected.recordSize) return packTable.value();
+    if (content.size() < sizeof(header) + header.records * sizeof(PackedEntry)) return packTable.value();
+    PackedEntry packed;
+    for (uint64_t i = 0; i < header.records; i++) {
+        std::memcpy(&packed, content.data() + sizeof(header) + i * sizeof(PackedEntry), sizeof(PackedEntry));
+        packTable->insert_or_assign(packed.entry, packed);
+    }
+    return packTable.value();
+}
+
+std::optional<PackedEntry> Clipboard::packedEntryFor(const unsigned long& entryNumber) {
+    if (!packTable && !fs::exists(packs)) return std::nullopt; // don't bother loading anything if nothing was ever packed
+    if (auto packed = packedEntries().find(entryNumber); packed != packedEntries().end()) return packed->second;
+    return std::nullopt;
+}
+
+std::string Clipboard::packedContents(const PackedEntry& packed, const size_t& limit) {
+    std::string content(std::min<uint64_t>(packed.length, limit), '\0');
+    std::ifstream segment(segmentPath(packs, packed.segment), std::ios::binary);
+    segment.seekg(packed.offset);
+    segment.read(content.data(), content.size());
+    if (segment.gcount() != static_cast<std::streamsize>(content.size())) throw fs::filesystem_error("Packed entry is incomplete", segmentPath(packs, packed.segment), std::make_error_code(std::errc::io_error));
+    return content;
+}
+
+PackedEntry Clipboard::appendToPack(const unsigned long& entryNumber, const int64_t& time, const std::string& content, const uint32_t& minimumSegment) {
+    PackedEntry packed;
+    packed.entry = entryNumber;
+    packed.time = time;
+    packed.length = content.size();
+
+    // keep appending to the newest segment until it gets too big
+    packed.segment = minimumSegment;
+    for (const auto& [entry, other] : packedEntries())
+        packed.segment = std::max(packed.segment, other.segment);
+    std::error_code ec;
+    auto segmentSize = fs::file_size(segmentPath(packs, packed.segment), ec);
+    if (ec) segmentSize = 0;
+    if (segmentSize >= constants.pack_segment_size) {
+        packed.segment++;
+        segmentSize = 0;
+    }
+
+    PackHeader header {entryNumber, time, content.size()};
+    std::string buffer(reinterpret_cast<const char*>(&header), sizeof(header));
+    buffer += content;
+    fs::create_directories(packs);
+    writeDurably(segmentPath(packs, packed.segment), buffer, true);
+    packed.offset = segmentSize + sizeof(header);
+
+    packedEntries().insert_or_assign(entryNumber, packed);
+    packTableChanged = true;
+    return packed;
+}
+
+void Clipboard::savePackTable() {
+    if (!packTableChanged) return;
+    PackTableHeader header;
+    header.records = packedEntries().size();
+    std::string buffer(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (const auto& [entry, packed] : packedEntries())
+        buffer.append(reinterpret_cast<const char*>(&packed), sizeof(packed));
+    auto temporary = packs / constants.pack_table_name;
+    temporary += "." + std::to_string(thisPID());
+    fs::create_directories(packs);
+    try {
+        writeDurably(temporary, buffer);
+        fs::rename(temporary, packs / constants.pack_table_name);
+    } catch (const fs::filesystem_error& e) {
+        std::error_code ec;
+        fs::remove(temporary, ec);
+        throw;
+    }
+#if !defined(_WIN32) && !defined(_WIN64)
+    if (int directory = open(packs.string().data(), O_RDONLY | O_CLOEXEC); directory != -1) { // so that the rename itself is on disk too
+        fsync(directory);
+        close(directory);
+    }
+#endif
+    packTableChanged = false;
+}
+
+void Clipboard::unpackEntry(const unsigned long& entryNumber) {
+    auto packed = packedEntryFor(entryNumber);
+    if (!packed) return;
+    auto entryPath = root / constants.data_directory / std::to_string(entryNumber);
+    fs::create_directories(entryPath);
+    writeDurably(entryPath / constants.data_file_name, packedContents(packed.value())); // exactly the way it was stored
+    fs::last_write_time(entryPath, fs::file_time_type(fs::file_time_type::duration(packed->time))); // so that history still shows when this entry was made
+    packedEntries().erase(entryNumber);
+    packTableChanged = true;
+    savePackTable();
+}
+
+FileView Clipboard::rawDataFor(const unsigned long& entry) {
+    auto rawData = root / constants.data_directory / std::to_string(entryIndex.at(entry)) / constants.data_file_name;
+    if (auto packed = packedEntryFor(entryIndex.at(entry))) {
+        auto content = packedContents(packed.value());
+        if (isEncodedContent(content)) content = decodedContents(rawData, content); // packs keep content the way it was stored
+        return FileView(std::move(content));
+    }
+    return FileView(rawData);
+}
+
+size_t Clipboard::removeOldestEntry() {
+    auto entryNumber = entryIndex.back();
+    size_t size = recordFor(entryIndex.size() - 1).storedBytes;
+    if (packedEntryFor(entryNumber)) {
+        packedEntries().erase(entryNumber);
+        packTableChanged = true;
+    } else {
+        fs::remove_all(root / constants.data_directory / std::to_string(entryNumber));
+        releaseChunksOf(entryNumber);
+    }
+    forgetEntryRecord(entryNumber);
+    entryIndex.pop_back();
+    return size;
+}
+
+void Clipboard::packEntries() {
+    if (!envVarIsTrue("CLIPBOARD_PACKHISTORY")) return;
+    std::vector<unsigned long> packed;
+    // leave the newest entry and the one we're using as regular files because they're the most likely to be used next
+    for (unsigned long entry = 1; entry < entryIndex.size(); entry++) {
+        if (entry == this_entry || packedEntryFor(entryIndex.at(entry))) continue;
+        if (const auto& record = recordFor(entry); record.content != EntryContent::RawData) continue;
+        auto entryPath = root / constants.data_directory / std::to_string(entryIndex.at(entry));
+        // entries with files in them stay as directories
+        if (std::distance(fs::directory_iterator(entryPath), fs::directory_iterator()) != 1) continue;
+        // chunk references are kept per entry directory, so chunked entries stay as directories too
+        if (isChunkedFile(entryPath / constants.data_file_name)) continue;
+        std::ifstream input(entryPath / constants.data_file_name, std::ios::binary);
+        if (!input.is_open()) continue;
+        std::string content((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>()); // the way it's stored, so still compressed
+        try {
+            appendToPack(entryIndex.at(entry), recordFor(entry).time, content);
+            packed.emplace_back(entry);
+        } catch (const fs::filesystem_error& e) {
+            packedEntries().erase(entryIndex.at(entry));
+            break;
+        }
+    }
+    if (packed.empty()) return;
+    // the directories only go away once the table that says where their content went is on disk
+    try {
+        savePackTable();
+    } catch (const fs::filesystem_error& e) {
+        for (const auto& entry : packed)
+            packedEntries().erase(entryIndex.at(entry));
+        return;
+    }
+    for (const auto& entry : packed) {
+        fs::remove_all(root / constants.data_directory / std::to_string(entryIndex.at(entry)));
+        auto record = recordFor(entry);
+        record.storedBytes = packedEntryFor(entryIndex.at(entry))->length;
+        storeEntryRecord(std::move(record));
+    }
+    releaseUnusedObjects();
+}
+
+void Clipboard::compactPacks() {
+    savePackTable();
+    if (!fs::exists(packs)) return;
+
+    std::unordered_map<uint32_t, uint64_t> liveBytes;
+    uint32_t newestSegment = 0;
+    for (const auto& [entry, packed] : packedEntries()) {
+        liveBytes[packed.segment] += sizeof(PackHeader) + packed.length;
+        newestSegment = std::max(newestSegment, packed.segment);
+    }
+
+    std::vector<uint32_t> mostlyDead;
+    for (const auto& file : fs::directory_iterator(packs)) {
+        if (file.path().extension() != constants.pack_extension) continue;
+        uint32_t segment = 0;
+        try {
+            segment = std::stoul(file.path().stem().string());
+        } catch (...) {
+            continue;
+        }
+        if (!liveBytes.contains(segment))
+            fs::remove(file.path()); // nothing in here is used anymore
+        else if (segment != newestSegment && liveBytes[segment] * 2 < file.file_size())
+            mostlyDead.emplace_back(segment);
+    }
+
+    // move whatever is still used out of the mostly dead segments so that those can be removed
+    for (const auto& segment : mostlyDead) {
+        std::vector<PackedEntry> live;
+        for (const auto& [entry, packed] : packedEntries())
+            if (packed.segment == segment) live.emplace_back(packed);
+        for (const auto& packed : live)
+            appendToPack(packed.entry, packed.time, packedContents(packed), newestSegment + 1);
+        savePackTable();
+        fs::remove(segmentPath(packs, segment));
+    }
+}
@@ -0,0 +1,361 @@
+/*  The Clipboard Project - Cut, copy, and paste anything, anytime, anywhere, all from the terminal.
+    Copyright (C) 2023 Jackson Huff and other contributors on GitHub.com
+    SPDX-License-Identifier: GPL-3.0-or-later
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.*/
+#include "clipboard.hpp"
+#include <numeric>
+
+// The search index maps every trigram to the entries that have it, so a search only has to look at entries that have all the trigrams of
+// what it's looking for. The merged index is one file of entries, a sorted table of trigrams, and the entry numbers of each trigram as
+// ascending varint deltas. New entries go into a small file of additions instead, which gets merged in once it's big enough.
+// Anything that's not in the index or changed since it was indexed is always searched, so the index never has to be perfectly current.
+
+struct SearchIndexHeader {
+    std::array<char, 8> magic {'C', 'B', 'S', 'E', 'A', 'R', 'C', 'H'};
+    uint32_t version = 1;
+    uint32_t reserved = 0;
+    uint64_t entries = 0;
+    uint64_t trigrams = 0;
+};
+
+struct MergedEntry {
+    uint64_t entry = 0;
+    int64_t contentTime = 0;
+    uint64_t complete = 0;
+};
+
+struct TrigramSlot {
+    uint32_t trigram = 0;
+    uint32_t count = 0;
+    uint64_t offset = 0; // where its entry numbers start, from the end of the slots
+};
+
+struct AdditionsHeader {
+    std::array<char, 8> magic {'C', 'B', 'S', 'E', 'A', 'R', 'C', 'N'};
+    uint32_t version = 1;
+    uint32_t reserved = 0;
+    uint64_t entries = 0;
+};
+
+struct AdditionHeader {
+    uint64_t entry = 0;
+    int64_t contentTime = 0;
+    uint32_t complete = 0;
+    uint32_t trigrams = 0;
+};
+
+template <typename T>
+static T readAt(const char* data, const size_t& offset) {
+    T value;
+    std::memcpy(&value, data + offset, sizeof(T));
+    return value;
+}
+
+std::vector<uint32_t> trigramsOf(const std::string_view& content) {
+    std::vector<uint32_t> trigrams;
+    if (content.size() < 3) return trigrams;
+    auto trigramAt = [&](const size_t& i) {
+        return (static_cast<uint32_t>(static_cast<unsigned char>(content[i])) << 16) | (static_cast<uint32_t>(static_cast<unsigned char>(content[i + 1])) << 8)
+             | static_cast<unsigned char>(content[i + 2]);
+    };
+    if (content.size() < 64 * 1024) {
+        trigrams.reserve(content.size() - 2);
+        for (size_t i = 0; i + 2 < content.size(); i++)
+            trigrams.emplace_back(trigramAt(i));
+        std::sort(trigrams.begin(), trigrams.end());
+        trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+        return trigrams;
+    }
+    // big content has most of its trigrams many times over, so mark them off instead of sorting them all
+    std::vector<uint64_t> seen((1 << 24) / 64, 0);
+    for (size_t i = 0; i + 2 < content.size(); i++) {
+        auto trigram = trigramAt(i);
+        seen[trigram / 64] |= 1ull << (trigram % 64);
+    }
+    for (uint32_t word = 0; word < seen.size(); word++)
+        for (auto bits = seen[word]; bits != 0; bits &= bits - 1)
+            trigrams.emplace_back(word * 64 + std::countr_zero(bits));
+    return trigrams;
+}
+
+static void appendVarint(std::string& buffer, uint64_t value) {
+    while (value >= 0x80) {
+        buffer += static_cast<char>((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    buffer += static_cast<char>(value);
+}
+
+static uint64_t readVarint(const char* data, size_t& offset) {
+    uint64_t value = 0;
+    for (int shift = 0;; shift += 7) {
+        auto byte = static_cast<unsigned char>(data[offset++]);
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return value;
+    }
+}
+
+// Everything about the merged index that's needed to look things up in it, read straight out of the mapped file
+class MergedIndex {
+    const char* data = nullptr;
+    SearchIndexHeader header;
+    size_t slotsStart = 0;
+    size_t postingsStart = 0;
+    size_t size = 0;
+
+public:
+    explicit MergedIndex(const FileView& file) {
+        SearchIndexHeader expected;
+        if (file.size() < sizeof(header)) return;
+        std::memcpy(&header, file.data(), sizeof(header));
+        if (header.magic != expected.magic || header.version != expected.version) return;
+        slotsStart = sizeof(header) + header.entries * sizeof(MergedEntry);
+        postingsStart = slotsStart + header.trigrams * sizeof(TrigramSlot);
+        if (file.size() < postingsStart) return;
+        data = file.data();
+        size = file.size();
+    }
+
+    uint64_t entries() const { return data ? header.entries : 0; }
+    uint64_t trigrams() const { return data ? header.trigrams : 0; }
+    MergedEntry entry(const size_t& index) const { return readAt<MergedEntry>(data, sizeof(header) + index * sizeof(MergedEntry)); }
+    TrigramSlot slot(const size_t& index) const { return readAt<TrigramSlot>(data, slotsStart + index * sizeof(TrigramSlot)); }
+
+    std::optional<MergedEntry> find(const unsigned long& entryNumber) const {
+        size_t low = 0, high = entries();
+        while (low < high) {
+            auto middle = low + (high - low) / 2;
+            if (entry(middle).entry < entryNumber)
+                low = middle + 1;
+            else
+                high = middle;
+        }
+        if (low < entries() && entry(low).entry == entryNumber) return entry(low);
+        return std::nullopt;
+    }
+
+    std::vector<uint64_t> entriesWith(const TrigramSlot& slot) const {
+        std::vector<uint64_t> entries(slot.count);
+        size_t offset = postingsStart + slot.offset;
+        uint64_t previous = 0;
+        for (auto& entry : entries) {
+            if (offset >= size) break;
+            entry = previous += readVarint(data, offset);
+        }
+        return entries;
+    }
+
+    std::vector<uint64_t> entriesWith(const uint32_t& trigram) const {
+        size_t low = 0, high = trigrams();
+        while (low < high) {
+            auto middle = low + (high - low) / 2;
+            if (slot(middle).trigram < trigram)
+                low = middle + 1;
+            else
+                high = middle;
+        }
+        if (low < trigrams() && slot(low).trigram == trigram) return entriesWith(slot(low));
+        return {};
+    }
+};
+
+SearchIndex& Clipboard::searchIndex() {
+    if (loadedSearchIndex) return *loadedSearchIndex;
+    loadedSearchIndex = std::make_shared<SearchIndex>();
+    try {
+        loadedSearchIndex->merged = FileView(metadata.search_index);
+        FileView additions(metadata.search_additions);
+        AdditionsHeader expected, header;
+        if (additions.size() < sizeof(header)) return *loadedSearchIndex;
+        std::memcpy(&header, additions.data(), sizeof(header));
+        if (header.magic != expected.magic || header.version != expected.version) return *loadedSearchIndex;
+        size_t offset = sizeof(header);
+        for (uint64_t i = 0; i < header.entries && offset + sizeof(AdditionHeader) <= additions.size(); i++) {
+            auto addition = readAt<AdditionHeader>(additions.data(), offset);
+            offset += sizeof(AdditionHeader);
+            if (offset + addition.trigrams * sizeof(uint32_t) > additions.size()) break;
+            IndexedEntry indexed {addition.contentTime, addition.complete != 0, std::vector<uint32_t>(addition.trigrams)};
+            std::memcpy(indexed.trigrams.data(), additions.data() + offset, addition.trigrams * sizeof(uint32_t));
+            offset += addition.trigrams * sizeof(uint32_t);
+            loadedSearchIndex->additions.insert_or_assign(addition.entry, std::move(indexed));
+        }
+    } catch (const std::exception& e) {
+        loadedSearchIndex->additions.clear(); // a broken index only means searching everything again
+    }
+    return *loadedSearchIndex;
+}
+
+bool Clipboard::isIndexedForSearch(const unsigned long& entry) {
+    auto& index = searchIndex();
+    auto contentTime = recordFor(entry).contentTime;
+    if (auto addition = index.additions.find(entryIndex.at(entry)); addition != index.additions.end()) return addition->second.contentTime == contentTime;
+    auto merged = MergedIndex(index.merged).find(entryIndex.at(entry));
+    return merged && merged->contentTime == contentTime;
+}
+
+IndexedEntry indexedContent(const std::string_view& content) {
+    IndexedEntry indexed;
+    indexed.complete = content.size() <= constants.search_index_limit;
+    if (indexed.complete) indexed.trigrams = trigramsOf(content);
+    return indexed;
+}
+
+void Clipboard::indexForSearch(const unsigned long& entry, IndexedEntry&& indexed) {
+    auto& index = searchIndex();
+    indexed.contentTime = recordFor(entry).contentTime;
+    index.additions.insert_or_assign(entryIndex.at(entry), std::move(indexed));
+    index.changed = true;
+}
+
+void Clipboard::indexForSearch(const unsigned long& entry, const std::string_view& content) {
+    indexForSearch(entry, indexedContent(content));
+}
+
+void Clipboard::indexForSearch(const unsigned long& entry) {
+    const auto& record = recordFor(entry);
+    if (record.content == EntryContent::RawData) {
+        if (record.bytes > constants.search_index_limit) return indexForSearch(entry, std::string(constants.search_index_limit + 1, '\0')); // too big to bother reading
+        indexForSearch(entry, rawDataFor(entry).content());
+    } else {
+        std::string names; // search looks at each item's name, and all of them together have every trigram any one of them does
+        for (const auto& item : fs::directory_iterator(entryPathFor(entry)))
+            names.append(item.path().filename().string()).append(1, '\n');
+        indexForSearch(entry, names);
+    }
+}
+
+std::vector<unsigned long> Clipboard::entriesPossiblyContaining(const std::vector<std::string>& literals) {
+    std::vector<uint32_t> needed;
+    for (const auto& literal : literals) {
+        auto trigrams = trigramsOf(literal);
+        needed.insert(needed.end(), trigrams.begin(), trigrams.end());
+    }
+    std::sort(needed.begin(), needed.end());
+    needed.erase(std::unique(needed.begin(), needed.end()), needed.end());
+
+    std::vector<unsigned long> entries;
+    if (needed.empty()) { // nothing to narrow it down with
+        entries.resize(entryIndex.size());
+        std::iota(entries.begin(), entries.end(), 0);
+        return entries;
+    }
+
+    auto& index = searchIndex();
+    MergedIndex merged(index.merged);
+    std::vector<uint64_t> mergedMatches;
+    if (merged.entries() > 0) {
+        // start with the rarest trigram so the intersection stays small
+        std::vector<std::vector<uint64_t>> lists;
+        for (const auto& trigram : needed)
+            lists.emplace_back(merged.entriesWith(trigram));
+        std::sort(lists.begin(), lists.end(), [](const auto& a, const auto& b) { return a.size() < b.size(); });
+        mergedMatches = std::move(lists.front());
+        for (size_t list = 1; list < lists.size() && !mergedMatches.empty(); list++) {
+            std::vector<uint64_t> both;
+            std::set_intersection(mergedMatches.begin(), mergedMatches.end(), lists[list].begin(), lists[list].end(), std::back_inserter(both));
+            mergedMatches = std::move(both);
+        }
+    }
+
+    for (unsigned long entry = 0; entry < entryIndex.size(); entry++) {
+        const auto& record = recordFor(entry);
+        auto entryNumber = entryIndex.at(entry);
+        if (auto addition = index.additions.find(entryNumber); addition != index.additions.end()) {
+            const auto& indexed = addition->second;
+            if (indexed.contentTime != record.contentTime || !indexed.complete || std::includes(indexed.trigrams.begin(), indexed.trigrams.end(), needed.begin(), needed.end()))
+                entries.emplace_back(entry);
+        } else if (auto indexed = merged.find(entryNumber); !indexed || indexed->contentTime != record.contentTime || !indexed->complete
+                                                             || std::binary_search(mergedMatches.begin(), mergedMatches.end(), entryNumber))
+            entries.emplace_back(entry);
+    }
+    return entries;
+}
+
+void Clipboard::saveSearchIndex() {
+    if (!loadedSearchIndex || !loadedSearchIndex->changed) return;
+    auto& index = *loadedSearchIndex;
+    auto isLive = [&](const uint64_t& entryNumber) { return std::binary_search(entryIndex.begin(), entryIndex.end(), entryNumber, std::greater<>()); };
+    std::erase_if(index.additions, [&](const auto& addition) { return !isLive(addition.first); });
+
+    MergedIndex merged(index.merged);
+    std::string buffer;
+    fs::path target;
+
+    // merging rewrites everything, so only do it once the additions are big enough that reading them every time costs more
+    if (index.additions.size() > 256 && index.additions.size() > merged.entries() / 8) {
+        std::vector<MergedEntry> entries;
+        std::map<uint32_t, std::vector<uint64_t>> postings;
+        for (uint64_t i = 0; i < merged.entries(); i++)
+            if (auto entry = merged.entry(i); isLive(entry.entry) && !index.additions.contains(entry.entry)) entries.emplace_back(entry);
+        for (uint64_t i = 0; i < merged.trigrams(); i++) {
+            auto slot = merged.slot(i);
+            auto& list = postings[slot.trigram];
+            for (const auto& entry : merged.entriesWith(slot))
+                if (isLive(entry) && !index.additions.contains(entry)) list.emplace_back(entry);
+        }
+        for (const auto& [entryNumber, indexed] : index.additions) {
+            entries.emplace_back(entryNumber, indexed.contentTime, indexed.complete);
+            for (const auto& trigram : indexed.trigrams)
+                postings[trigram].emplace_back(entryNumber);
+        }
+        std::sort(entries.begin(), entries.end(), [](const auto& a, const auto& b) { return a.entry < b.entry; });
+        std::erase_if(postings, [](const auto& list) { return list.second.empty(); });
+
+        SearchIndexHeader header;
+        header.entries = entries.size();
+        header.trigrams = postings.size();
+        buffer.append(reinterpret_cast<const char*>(&header), sizeof(header));
+        buffer.append(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(MergedEntry));
+        std::string lists;
+        for (auto& [trigram, list] : postings) {
+            std::sort(list.begin(), list.end());
+            TrigramSlot slot {trigram, static_cast<uint32_t>(list.size()), lists.size()};
+            buffer.append(reinterpret_cast<const char*>(&slot), sizeof(slot));
+            uint64_t previous = 0;
+            for (const auto& entry : list) {
+                appendVarint(lists, entry - previous);
+                previous = entry;
+            }
+        }
+        buffer.append(lists);
+        target = metadata.search_index;
+    } else {
+        AdditionsHeader header;
+        header.entries = index.additions.size();
+        buffer.append(reinterpret_cast<const char*>(&header), sizeof(header));
+        for (const auto& [entryNumber, indexed] : index.additions) {
+            AdditionHeader addition {entryNumber, indexed.contentTime, indexed.complete, static_cast<uint32_t>(indexed.trigrams.size())};
+            buffer.append(reinterpret_cast<const char*>(&addition), sizeof(addition));
+            buffer.append(reinterpret_cast<const char*>(indexed.trigrams.data()), indexed.trigrams.size() * sizeof(uint32_t));
+        }
+        target = metadata.search_additions;
+    }
+
+    // same as the entry index, write it separately and swap it in so nobody sees half of it
+    auto temporary = target;
+    temporary += "." + std::to_string(thisPID());
+    try {
+        fs::create_directories(metadata);
+        writeToFile(temporary, buffer);
+        fs::rename(temporary, target);
+        if (target == metadata.search_index) {
+            fs::remove(metadata.search_additions);
+            index.additions.clear();
+            index.merged = FileView(metadata.search_index);
+        }
+        index.changed = false;
+    } catch (const fs::filesystem_error& e) {
+        fs::remove(temporary);
+    }
+}
@@ -15,28 +15,87 @@
     along with this program.  If not, see <https://www.gnu.org/licenses/>.*/
 #include "../clipboard.hpp"
 
-unsigned long levenshteinDistance(const std::string_view& one, const std::string_view& two) {
-    if (one == two) return 0;
+// Both of these are Myers' bit-parallel edit distance as Hyyrö describes it for whole strings. Each bit of a word is one row of the usual
+// matrix, holding whether going down a row adds or takes away one from the distance, so a whole column gets done with a few instructions.
+// The distance in the last row is kept along the way, and once it can't come back under the maximum with what's left, we stop and say it's
+// maxDistance + 1, since nobody cares how far something is once it's too far.
+
+static unsigned long singleWordDistance(const std::string_view& pattern, const std::string_view& text, const unsigned long& maxDistance) {
+    std::array<uint64_t, 256> matches {};
+    for (size_t row = 0; row < pattern.size(); row++)
+        matches[static_cast<unsigned char>(pattern[row])] |= 1ull << row;
 
-    if (one.empty()) return two.size();
-    if (two.empty()) return one.size();
+    uint64_t plus = ~0ull, minus = 0;
+    uint64_t last = 1ull << (pattern.size() - 1);
+    unsigned long distance = pattern.size();
 
-    std::vector<std::vector<size_t>> matrix(one.size() + 1, std::vector<size_t>(two.size() + 1));
+    for (size_t column = 0; column < text.size(); column++) {
+        auto equal = matches[static_cast<unsigned char>(text[column])];
+        auto vertical = equal | minus;
+        auto horizontal = (((equal & plus) + plus) ^ plus) | equal;
+        auto horizontalPlus = minus | ~(horizontal | plus);
+        auto horizontalMinus = plus & horizontal;
+        if (horizontalPlus & last)
+            distance++;
+        else if (horizontalMinus & last)
+            distance--;
+        horizontalPlus = (horizontalPlus << 1) | 1; // the top row goes up by one every column
+        horizontalMinus <<= 1;
+        plus = horizontalMinus | ~(vertical | horizontalPlus);
+        minus = horizontalPlus & vertical;
+        if (auto remaining = text.size() - column - 1; distance > remaining && distance - remaining > maxDistance) return maxDistance + 1;
+    }
+    return distance;
+}
 
-    for (size_t i = 0; i <= one.size(); i++)
-        matrix.at(i).at(0) = i;
+static unsigned long multiWordDistance(const std::string_view& pattern, const std::string_view& text, const unsigned long& maxDistance) {
+    auto words = (pattern.size() + 63) / 64;
+    std::vector<uint64_t> matches(256 * words, 0);
+    for (size_t row = 0; row < pattern.size(); row++)
+        matches[static_cast<unsigned char>(pattern[row]) * words + row / 64] |= 1ull << (row % 64);
 
-    for (size_t j = 0; j <= two.size(); j++)
-        matrix.at(0).at(j) = j;
+    std::vector<uint64_t> plus(words, ~0ull), minus(words, 0);
+    uint64_t last = 1ull << ((pattern.size() - 1) % 64);
+    unsigned long distance = pattern.size();
 
-    for (size_t i = 1; i <= one.size(); i++) {
-        for (size_t j = 1; j <= two.size(); j++) {
-            if (one.at(i - 1) == two.at(j - 1))
-                matrix.at(i).at(j) = matrix.at(i - 1).at(j - 1);
-            else
-                matrix.at(i).at(j) = std::min({matrix.at(i - 1).at(j - 1), matrix.at(i - 1).at(j), matrix.at(i).at(j - 1)}) + 1;
+    for (size_t column = 0; column < text.size(); column++) {
+        const auto* equals = &matches[static_cast<unsigned char>(text[column]) * words];
+        int carry = 1; // what the row above this word changed by, which starts as the top row going up by one
+        for (size_t word = 0; word < words; word++) {
+            auto equal = equals[word];
+            auto vertical = equal | minus[word];
+            if (carry < 0) equal |= 1;
+            auto horizontal = (((equal & plus[word]) + plus[word]) ^ plus[word]) | equal;
+            auto horizontalPlus = minus[word] | ~(horizontal | plus[word]);
+            auto horizontalMinus = plus[word] & horizontal;
+            auto bottom = word == words - 1 ? last : 1ull << 63;
+            int nextCarry = (horizontalPlus & bottom) ? 1 : (horizontalMinus & bottom) ? -1 : 0;
+            horizontalPlus <<= 1;
+            horizontalMinus <<= 1;
+            if (carry < 0)
+                horizontalMinus |= 1;
+            else if (carry > 0)
+                horizontalPlus |= 1;
+            plus[word] = horizontalMinus | ~(vertical | horizontalPlus);
+            minus[word] = horizontalPlus & vertical;
+            carry = nextCarry;
         }
+        distance += carry;
+        if (auto remaining = text.size() - column - 1; distance > remaining && distance - remaining > maxDistance) return maxDistance + 1;
     }
+    return distance;
+}
+
+unsigned long levenshteinDistance(const std::string_view& one, const std::string_view& two, const unsigned long& maxDistance) {
+    if (one == two) return 0;
+
+    // the shorter string goes down the side so there are fewer words to keep track of
+    const auto& pattern = one.size() <= two.size() ? one : two;
+    const auto& text = one.size() <= two.size() ? two : one;
+
+    if (text.size() - pattern.size() > maxDistance) return maxDistance + 1;
+    if (pattern.empty()) return text.size();
 
-    return matrix.at(one.size()).at(two.size());
-};
\ No newline at end of file
+    if (pattern.size() <= 64) return singleWordDistance(pattern, text, maxDistance);
+    return multiWordDistance(pattern, text, maxDistance);
+}
@@ -14,41 +14,123 @@
     You should have received a copy of the GNU General Public License
     along with this program.  If not, see <https://www.gnu.org/licenses/>.*/
 #include "../clipboard.hpp"
+#include <clipboard/logging.hpp>
 #include <fstream>
+#include <limits>
+#include <openssl/evp.h>
+#include <utility>
 
-std::optional<std::string> fileContents(const fs::path& path) {
+#if defined(__linux__)
+#include <linux/fs.h>
+#endif
+
+#if defined(__linux__) || defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#endif
+
+FileView::FileView(const fs::path& path) {
 #if defined(__linux__) || defined(__unix__) || defined(__APPLE__)
     errno = 0;
-    int fd = open(path.string().data(), O_RDONLY);
+    int fd = open(path.string().data(), O_RDONLY | O_CLOEXEC);
     if (fd == -1) {
-        if (errno == ENOENT)
-            return std::nullopt;
-        else
-            throw std::runtime_error("Couldn't open file " + path.string() + ": " + std::strerror(errno));
+        if (errno == ENOENT) return;
+        throw std::runtime_error("Couldn't open file " + path.string() + ": " + std::strerror(errno));
+    }
+    found = true;
+    struct stat info {};
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && static_cast<size_t>(info.st_size) >= constants.file_mapping_threshold) {
+        mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED)
+            mapping = nullptr;
+        else {
+            mappingLength = info.st_size;
+            view = {static_cast<const char*>(mapping), mappingLength};
+        }
     }
-    std::string contents;
+    if (!mapping) {
+        // small files are quicker to just read, and things like pipes can't be mapped at all
+        if (S_ISREG(info.st_mode)) owned.reserve(info.st_size);
 #if defined(__linux__) || defined(__FreeBSD__)
-    std::array<char, 65536> buffer;
+        std::array<char, 65536> buffer;
 #elif defined(__APPLE__) || defined(__OpenBSD__) || defined(__NetBSD__) || defined(__DragonFly__)
-    std::array<char, 16384> buffer;
+        std::array<char, 16384> buffer;
 #else
-    std::array<char, PIPE_BUF> buffer;
+        std::array<char, PIPE_BUF> buffer;
 #endif
-    ssize_t bytes_read;
-    errno = 0;
-    while ((bytes_read = read(fd, buffer.data(), buffer.size())) > 0) {
-        contents.append(buffer.data(), bytes_read);
-        if (bytes_read < buffer.size() && errno == 0) break; // check if we reached EOF early and not due to an error
+        ssize_t bytes_read;
+        while ((bytes_read = read(fd, buffer.data(), buffer.size())) != 0) {
+            if (bytes_read == -1) {
+                if (errno == EINTR) continue;
+                close(fd);
+                throw std::runtime_error("Couldn't read file " + path.string() + ": " + std::strerror(errno));
+            }
+            owned.append(buffer.data(), bytes_read);
+        }
+        view = owned;
     }
     close(fd);
-    return contents;
 #else
-    std::stringstream buffer;
     std::ifstream file(path, std::ios::binary);
-    if (!file.is_open()) return std::nullopt;
+    if (!file.is_open()) return;
+    found = true;
+    std::stringstream buffer;
     buffer << file.rdbuf();
-    return buffer.str();
+    owned = buffer.str();
+    view = owned;
+#endif
+    if (path.filename() == constants.data_file_name && isEncodedFile(path)) { // clipboards can keep their content compressed or in chunks
+        auto decoded = decodedContents(path, view);
+        release();
+        owned = std::move(decoded);
+        view = owned;
+    }
+}
+
+FileView::FileView(std::string&& content) : owned(std::move(content)), view(owned), found(true) {}
+
+FileView::FileView(FileView&& other) noexcept {
+    *this = std::move(other);
+}
+
+FileView& FileView::operator=(FileView&& other) noexcept {
+    if (this == &other) return *this;
+    release();
+    found = std::exchange(other.found, false);
+    mapping = std::exchange(other.mapping, nullptr);
+    mappingLength = std::exchange(other.mappingLength, 0);
+    if (mapping) {
+        view = other.view;
+    } else {
+        owned = std::move(other.owned);
+        view = owned; // moving a short string moves where its characters are too
+    }
+    other.view = {};
+    return *this;
+}
+
+FileView::~FileView() {
+    release();
+}
+
+void FileView::release() {
+#if defined(__linux__) || defined(__unix__) || defined(__APPLE__)
+    if (mapping) munmap(mapping, mappingLength);
 #endif
+    mapping = nullptr;
+    mappingLength = 0;
+    owned.clear();
+    view = {};
+}
+
+std::string FileView::string() && {
+    if (mapping) return std::string(view);
+    return std::move(owned);
+}
+
+std::optional<std::string> fileContents(const fs::path& path) {
+    FileView file(path);
+    if (!file) return std::nullopt;
+    return std::move(file).string();
 }
 
 std::vector<std::string> fileLines(const fs::path& path) {
@@ -61,8 +143,272 @@ std::vector<std::string> fileLines(const fs::path& path) {
     return lines;
 }
 
+std::string sha256Of(const fs::path& file) {
+    std::array<unsigned char, EVP_MAX_MD_SIZE> hash;
+    unsigned int hashLength = 0;
+    auto context = EVP_MD_CTX_new();
+    EVP_DigestInit_ex(context, EVP_sha256(), nullptr);
+    std::ifstream input(file, std::ios::binary);
+    std::array<char, 65536> buffer;
+    while (input.read(buffer.data(), buffer.size()) || input.gcount() > 0)
+        EVP_DigestUpdate(context, buffer.data(), input.gcount());
+    EVP_DigestFinal_ex(context, hash.data(), &hashLength);
+    EVP_MD_CTX_free(context);
+    std::stringstream ss;
+    for (unsigned int i = 0; i < hashLength; i++)
+        ss << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(hash[i]);
+    return ss.str();
+}
+
+void unshareFile(const fs::path& path) {
+    std::error_code ec;
+    if (fs::is_symlink(path, ec)) return;
+    if (fs::is_directory(path, ec)) {
+        for (const auto& entry : fs::recursive_directory_iterator(path))
+            if (entry.is_regular_file() && !entry.is_symlink()) unshareFile(entry.path());
+        return;
+    }
+    if (fs::hard_link_count(path, ec) <= 1 || ec) return;
+    // this content is shared with other history entries, so give this path its own copy before anyone modifies it
+    auto temporary = path;
+    temporary += ".unshared";
+    copyFile(path, temporary);
+    fs::rename(temporary, path);
+}
+
+std::string_view copyMethodName(const CopyMethod& method) {
+    switch (method) {
+    case CopyMethod::Reflink:
+        return "reflink";
+    case CopyMethod::CopyFileRange:
+        return "copy_file_range";
+    default:
+        return "read/write";
+    }
+}
+
+CopyMethod copyFile(const fs::path& from, const fs::path& to) {
+#if defined(__linux__) || defined(__unix__) || defined(__APPLE__)
+    auto fail = [&] { throw fs::filesystem_error("Couldn't copy", from, to, std::error_code(errno, std::generic_category())); };
+    struct Descriptor {
+        int fd = -1;
+        ~Descriptor() {
+            if (fd != -1) close(fd);
+        }
+    } input, output;
+    input.fd = open(from.string().data(), O_RDONLY | O_CLOEXEC);
+    if (input.fd == -1) fail();
+    struct stat info;
+    if (fstat(input.fd, &info) == -1) fail();
+    // overwrite an existing file in place so that its hard links, owner, permissions, and anyone who has it open all stay intact,
+    // which means whatever writes into a clipboard has to unshare its targets first
+    std::error_code ec;
+    auto existing = fs::symlink_status(to, ec);
+    if (fs::is_regular_file(existing)) output.fd = open(to.string().data(), O_WRONLY | O_TRUNC | O_NOFOLLOW | O_CLOEXEC);
+    if (output.fd == -1) {
+        // it's missing, something other than a file like a symlink, or can't be written to, so start over with a new file instead
+        if (fs::exists(existing) && !fs::is_directory(existing)) fs::remove(to, ec);
+        output.fd = open(to.string().data(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, info.st_mode & 07777);
+        if (output.fd == -1) fail();
+        fchmod(output.fd, info.st_mode & 07777);
+    }
+
+#if defined(__linux__)
+#if defined(FICLONE)
+    // on CoW filesystems like Btrfs and XFS, both files can share the same extents until one of them changes
+    if (ioctl(output.fd, FICLONE, input.fd) == 0) return CopyMethod::Reflink;
+#endif
+    // otherwise, let the kernel copy the data without bringing it into userspace
+    while (true) {
+        auto copied = copy_file_range(input.fd, nullptr, output.fd, nullptr, std::numeric_limits<ssize_t>::max() / 2, 0);
+        if (copied == 0) return CopyMethod::CopyFileRange;
+        if (copied > 0 || errno == EINTR) continue;
+        // some filesystems and older kernels can't do this, so finish the copy by hand from wherever it stopped
+        if (errno != EXDEV && errno != ENOSYS && errno != EINVAL && errno != EOPNOTSUPP) fail();
+        break;
+    }
+#endif
+
+    std::vector<char> buffer(1024 * 1024);
+    while (true) {
+        auto bytesRead = read(input.fd, buffer.data(), buffer.size());
+        if (bytesRead == 0) break;
+        if (bytesRead == -1) {
+            if (errno == EINTR) continue;
+            fail();
+        }
+        for (ssize_t written = 0; written < bytesRead;) {
+            auto bytesWritten = write(output.fd, buffer.data() + written, bytesRead - written);
+            if (bytesWritten == -1) {
+                if (errno == EINTR) continue;
+                fail();
+            }
+            written += bytesWritten;
+        }
+    }
+    return CopyMethod::ReadWrite;
+#else
+    fs::copy_file(from, to, fs::copy_options::overwrite_existing);
+    return CopyMethod::ReadWrite;
+#endif
+}
+
+static void copyNode(const fs::path& from, const fs::path& to, const fs::copy_options& options, const std::function<void(const fs::path&, const fs::path&)>& copyChild) {
+    auto has = [&](const fs::copy_options& option) { return (options & option) != fs::copy_options::none; };
+    auto fromStatus = has(fs::copy_options::copy_symlinks) ? fs::symlink_status(from) : fs::status(from);
+    if (!fs::exists(fromStatus)) throw fs::filesystem_error("Couldn't copy", from, to, std::make_error_code(std::errc::no_such_file_or_directory));
+    auto toStatus = fs::symlink_status(to);
+
+    if (fs::is_symlink(fromStatus)) {
+        if (fs::exists(toStatus)) {
+            if (!has(fs::copy_options::overwrite_existing)) throw fs::filesystem_error("Couldn't copy", from, to, std::make_error_code(std::errc::file_exists));
+            fs::remove(to);
+        }
+        fs::copy_symlink(from, to);
+        return;
+    }
+    if (fs::is_directory(fromStatus)) {
+        fs::create_directories(to);
+        if (has(fs::copy_options::recursive))
+            for (const auto& entry : fs::directory_iterator(from))
+                copyChild(entry.path(), to / entry.path().filename());
+        return;
+    }
+    if (!fs::is_regular_file(fromStatus)) {
+        fs::copy(from, to, options); // let the standard library deal with anything unusual like FIFOs
+        return;
+    }
+    if (fs::is_directory(toStatus)) return copyNode(from, to / from.filename(), options, copyChild);
+    if (fs::exists(toStatus)) {
+        if (fs::equivalent(from, to)) throw fs::filesystem_error("Couldn't copy", from, to, std::make_error_code(std::errc::file_exists));
+        if (has(fs::copy_options::skip_existing)) return;
+        if (!has(fs::copy_options::overwrite_existing)) throw fs::filesystem_error("Couldn't copy", from, to, std::make_error_code(std::errc::file_exists));
+    }
+    auto method = copyFile(from, to);
+    debugStream << "Copied " << from << " to " << to << " using " << copyMethodName(method) << std::endl;
+}
+
+CopyEngine::CopyEngine(const fs::copy_options& options) : options(options) {
+    auto totalThreads = std::max(suitableThreadAmount(), 1u);
+    for (unsigned int i = 0; i < totalThreads; i++)
+        queues.emplace_back(std::make_unique<Queue>());
+}
+
+CopyEngine::~CopyEngine() {
+    wait();
+    {
+        std::lock_guard lock(sleepMutex);
+        stopping = true;
+    }
+    wakeUp.notify_all();
+    for (auto& thread : threads)
+        thread.join();
+}
+
+void CopyEngine::push(Task&& task, const size_t& queue) {
+    pendingTasks++;
+    {
+        std::lock_guard lock(sleepMutex);
+        queuedTasks++; // count it before anyone can take it
+        {
+            std::lock_guard queueLock(queues.at(queue)->mutex);
+            queues.at(queue)->tasks.emplace_back(std::move(task));
+        }
+        // only start as many threads as there is work for, so that copying one small file stays cheap
+        if (threads.size() < queues.size() && threads.size() < queuedTasks) threads.emplace_back(&CopyEngine::work, this, threads.size());
+    }
+    wakeUp.notify_one();
+}
+
+std::optional<CopyEngine::Task> CopyEngine::take(const size_t& queue) {
+    // work on our own newest tasks first so that trees get copied depth-first, and steal the oldest tasks of others because those are the biggest subtrees
+    for (size_t i = 0; i < queues.size(); i++) {
+        auto& victim = *queues.at((queue + i) % queues.size());
+        std::lock_guard lock(victim.mutex);
+        if (victim.tasks.empty()) continue;
+        Task task;
+        if (i == 0) {
+            task = std::move(victim.tasks.back());
+            victim.tasks.pop_back();
+        } else {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+        }
+        queuedTasks--;
+        return task;
+    }
+    return std::nullopt;
+}
+
+void CopyEngine::work(const size_t queue) {
+    while (true) {
+        if (auto task = take(queue)) {
+            try {
+                copyNode(task->from, task->to, options, [&](const fs::path& from, const fs::path& to) { push({from, to, task->item}, queue); });
+            } catch (const fs::filesystem_error& e) {
+                fail(task->item, e.code());
+            } catch (const std::exception& e) {
+                fail(task->item, std::make_error_code(std::errc::io_error));
+            }
+            if (--pendingTasks == 0) {
+                {
+                    std::lock_guard lock(sleepMutex); // so that wait() can't miss this
+                }
+                finished.notify_all();
+            }
+            continue;
+        }
+        std::unique_lock lock(sleepMutex);
+        wakeUp.wait(lock, [&] { return stopping || queuedTasks > 0; });
+        if (stopping) return;
+    }
+}
+
+void CopyEngine::fail(const size_t& item, const std::error_code& error) {
+    std::lock_guard lock(errorsMutex);
+    if (!errors.at(item)) errors.at(item) = error; // the first error is the most useful one
+}
+
+void CopyEngine::add(const fs::path& from, const fs::path& to) {
+    size_t item;
+    {
+        std::lock_guard lock(errorsMutex);
+        item = errors.size();
+        errors.emplace_back();
+    }
+    push({from, to, item}, item % queues.size());
+}
+
+std::vector<std::error_code> CopyEngine::wait() {
+    std::unique_lock lock(sleepMutex);
+    finished.wait(lock, [&] { return pendingTasks == 0; });
+    std::lock_guard errorsLock(errorsMutex);
+    return errors;
+}
+
+void copyPath(const fs::path& from, const fs::path& to, const fs::copy_options& options) {
+    CopyEngine engine(options);
+    engine.add(from, to);
+    if (auto error = engine.wait().front()) throw fs::filesystem_error("Couldn't copy", from, to, error);
+}
+
 size_t writeToFile(const fs::path& path, const std::string& content, bool append) {
+    std::error_code ec;
+    if (fs::hard_link_count(path, ec) > 1 && !ec) {
+        if (append)
+            unshareFile(path);
+        else
+            fs::remove(path);
+    }
+    if (append) decodeFile(path); // appending to compressed or chunked content would corrupt it
+    if (path.filename() == constants.data_file_name) { // plain raw data that starts like encoded content has to say that it's plain
+        auto existingSize = append ? fs::file_size(path, ec) : 0;
+        if (ec) existingSize = 0;
+        if (existingSize > 0 && existingSize < 8) return writeToFile(path, FileView(path).string() + content) - existingSize; // too short to know how it starts yet
+        if (existingSize == 0) append = false;
+    }
     std::ofstream file(path, append ? std::ios::app : std::ios::trunc | std::ios::binary);
+    if (!append && path.filename() == constants.data_file_name) file << escapeHeaderFor(content);
     file << content;
     return content.size();
 }
\ No newline at end of file
@@ -0,0 +1,258 @@
+/*  The Clipboard Project - Cut, copy, and paste anything, anytime, anywhere, all from the terminal.
+    Copyright (C) 2023 Jackson Huff and other contributors on GitHub.com
+    SPDX-License-Identifier: GPL-3.0-or-later
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.*/
+#include "../clipboard.hpp"
+#include <bit>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define HAVE_X86_SIMD
+#endif
+
+// This scores fuzzy matches the way fzf does. The query's characters have to show up in the content in order, and a Smith-Waterman style
+// table finds the way of picking them out that scores best: each one is worth more at the start of a word or right after the one before it,
+// and every byte skipped in between costs a little. Matches stay within a line, and each line only gets a table from where the first
+// character shows up to where the last one last does, and only if the query fits there at all. Finding that takes a vectorized scan for the
+// first character and a pass over the line, so long content costs little more than reading it. Unless the query has capital letters, case
+// doesn't matter.
+
+enum class CharacterClass : uint8_t { White, Delimiter, NonWord, Lower, Upper, Digit };
+
+static constexpr int scoreMatch = 16;
+static constexpr int gapStart = 3;
+static constexpr int gapExtension = 1;
+static constexpr int bonusBoundaryWhite = 10;
+static constexpr int bonusBoundaryDelimiter = 9;
+static constexpr int bonusBoundary = 8;
+static constexpr int bonusCamel = 7;
+static constexpr int bonusConsecutive = gapStart + gapExtension;
+static constexpr int firstCharacterMultiplier = 2;
+static constexpr int impossible = std::numeric_limits<int>::min() / 2;
+static constexpr size_t windowLimit = 512; // long lines only get looked at this far from where the first character is
+static constexpr size_t attemptLimit = 256; // how many tables, or tries within too-long lines, before settling for the best so far
+
+static constexpr auto characterClasses = [] {
+    using enum CharacterClass;
+    std::array<CharacterClass, 256> classes {};
+    for (size_t character = 0; character < classes.size(); character++) {
+        if (character >= 'a' && character <= 'z')
+            classes[character] = Lower;
+        else if (character >= 'A' && character <= 'Z')
+            classes[character] = Upper;
+        else if (character >= '0' && character <= '9')
+            classes[character] = Digit;
+        else if (character >= 0x80) // part of a UTF-8 character, which is most likely a letter
+            classes[character] = Lower;
+        else if (character == ' ' || (character >= '\t' && character <= '\r'))
+            classes[character] = White;
+        else if (std::string_view("/,:;|_-.").find(static_cast<char>(character)) != std::string_view::npos)
+            classes[character] = Delimiter;
+        else
+            classes[character] = NonWord;
+    }
+    return classes;
+}();
+
+static CharacterClass classOf(const char& character) {
+    return characterClasses[static_cast<unsigned char>(character)];
+}
+
+static int bonusFor(const CharacterClass& previous, const CharacterClass& current) {
+    using enum CharacterClass;
+    if (current > NonWord) {
+        if (previous == White) return bonusBoundaryWhite;
+        if (previous == Delimiter) return bonusBoundaryDelimiter;
+        if (previous == NonWord) return bonusBoundary;
+    }
+    if ((previous == Lower && current == Upper) || (previous != Digit && current == Digit)) return bonusCamel;
+    if (current == White) return bonusBoundaryWhite;
+    if (current == NonWord || current == Delimiter) return bonusBoundary;
+    return 0;
+}
+
+static unsigned char folded(const char& character, const bool& caseSensitive) {
+    auto byte = static_cast<unsigned char>(character);
+    return !caseSensitive && byte >= 'A' && byte <= 'Z' ? byte + ('a' - 'A') : byte;
+}
+
+static size_t findEither(const std::string_view& content, size_t from, const char& one, const char& two) {
+#if defined(HAVE_X86_SIMD)
+    auto first = _mm_set1_epi8(one);
+    auto second = _mm_set1_epi8(two);
+    for (; from + 16 <= content.size(); from += 16) {
+        auto chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(content.data() + from));
+        if (auto found = static_cast<uint32_t>(_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, first), _mm_cmpeq_epi8(chunk, second)))); found != 0)
+            return from + std::countr_zero(found);
+    }
+#endif
+    for (; from < content.size(); from++)
+        if (content[from] == one || content[from] == two) return from;
+    return std::string_view::npos;
+}
+
+// The table for one window, with a row for each character of the query and a column for each byte of the window. Scores only need the row
+// before, so only two rows of them are kept, while the whole table keeps how to get back to where each character was.
+struct ScoringTable {
+    std::vector<unsigned char> text; // the window with its case folded if it needs to be
+    std::vector<int> bonus;
+    std::array<std::vector<int>, 2> matched; // the best score with this character of the query right here
+    std::array<std::vector<int>, 2> chainBonus; // the bonus of the first character in the run of consecutive ones that ends here
+    std::array<std::vector<int>, 2> best; // the best score with this character of the query here or anywhere before, less the gap since then
+    std::vector<uint16_t> chained; // whether the best score here came from the character before being right before this one
+    std::vector<uint16_t> bestColumn; // where the character was for the best score here or before
+
+    void reset(const size_t& rows, const size_t& width) {
+        text.resize(width);
+        bonus.resize(width);
+        for (auto row : {0, 1}) {
+            matched[row].resize(width);
+            chainBonus[row].resize(width);
+            best[row].resize(width);
+        }
+        chained.resize(rows * width);
+        bestColumn.resize(rows * width);
+    }
+};
+
+static int scoreWindow(const std::string_view& content, const size_t& start, const size_t& end, const std::string_view& query, const bool& caseSensitive, ScoringTable& table, std::vector<size_t>& positions) {
+    auto width = end - start;
+    table.reset(query.size(), width);
+    auto previous = start == 0 ? CharacterClass::White : classOf(content[start - 1]);
+    for (size_t column = 0; column < width; column++) {
+        auto current = classOf(content[start + column]);
+        table.text[column] = folded(content[start + column], caseSensitive);
+        table.bonus[column] = bonusFor(previous, current);
+        previous = current;
+    }
+
+    for (size_t row = 0; row < query.size(); row++) {
+        // plain pointers keep the compiler from reloading everything after every store
+        const auto text = table.text.data();
+        const auto bonus = table.bonus.data();
+        auto matched = table.matched[row % 2].data();
+        auto chainBonus = table.chainBonus[row % 2].data();
+        auto best = table.best[row % 2].data();
+        const auto matchedBefore = table.matched[(row + 1) % 2].data();
+        const auto chainBonusBefore = table.chainBonus[(row + 1) % 2].data();
+        const auto bestBefore = table.best[(row + 1) % 2].data();
+        auto chained = table.chained.data() + row * width;
+        auto bestColumn = table.bestColumn.data() + row * width;
+        auto wanted = static_cast<unsigned char>(query[row]);
+        int left = impossible;
+        uint16_t leftColumn = 0;
+        bool leftIsGap = false; // whether the best score to the left skips that byte, so skipping this one only costs gapExtension
+        for (size_t column = 0; column < width; column++) {
+            matched[column] = impossible;
+            chained[column] = false;
+            if (text[column] == wanted) {
+                if (row == 0) {
+                    matched[column] = scoreMatch + bonus[column] * firstCharacterMultiplier;
+                    chainBonus[column] = bonus[column];
+                } else if (column > 0) {
+                    int chain = impossible, jump = impossible;
+                    if (matchedBefore[column - 1] > impossible)
+                        chain = matchedBefore[column - 1] + scoreMatch + std::max({bonus[column], chainBonusBefore[column - 1], bonusConsecutive});
+                    if (bestBefore[column - 1] > impossible) jump = bestBefore[column - 1] + scoreMatch + bonus[column];
+                    if (chain > impossible && chain >= jump) {
+                        matched[column] = chain;
+                        chainBonus[column] = chainBonusBefore[column - 1];
+                        chained[column] = true;
+                    } else if (jump > impossible) {
+                        matched[column] = jump;
+                        chainBonus[column] = bonus[column];
+                    }
+                }
+            }
+            if (auto gapped = left - (leftIsGap ? gapExtension : gapStart); left > impossible && gapped > matched[column]) {
+                left = gapped;
+                leftIsGap = true;
+            } else {
+                left = matched[column];
+                leftColumn = column;
+                leftIsGap = false;
+            }
+            best[column] = left;
+            bestColumn[column] = leftColumn;
+        }
+    }
+
+    // like fzf, whatever comes after the last character of the query doesn't count against it
+    const auto& lastRow = table.matched[(query.size() - 1) % 2];
+    int score = impossible;
+    size_t column = 0;
+    for (size_t candidate = 0; candidate < width; candidate++)
+        if (lastRow[candidate] > score) {
+            score = lastRow[candidate];
+            column = candidate;
+        }
+    if (score <= impossible) return impossible;
+    positions.resize(query.size());
+    for (size_t row = query.size(); row-- > 0;) {
+        positions[row] = start + column;
+        if (row == 0) break;
+        column = table.chained[row * width + column] ? column - 1 : table.bestColumn[(row - 1) * width + column - 1];
+    }
+    return score;
+}
+
+std::optional<FuzzyMatch> fuzzyMatch(const std::string_view& content, const std::string_view& query) {
+    if (query.empty() || query.size() > windowLimit || content.size() < query.size()) return std::nullopt;
+    bool caseSensitive = std::any_of(query.begin(), query.end(), [](const auto& character) { return character >= 'A' && character <= 'Z'; });
+    std::string pattern;
+    for (const auto& character : query)
+        pattern += static_cast<char>(folded(character, caseSensitive));
+    auto first = pattern.front();
+    auto firstOtherCase = !caseSensitive && first >= 'a' && first <= 'z' ? static_cast<char>(first - ('a' - 'A')) : first;
+    auto perfect = static_cast<int>(pattern.size()) * scoreMatch + bonusBoundaryWhite * (firstCharacterMultiplier + static_cast<int>(pattern.size()) - 1);
+
+    static thread_local ScoringTable table; // search calls this for every entry, so don't allocate a new table every time
+    std::optional<FuzzyMatch> bestMatch;
+    int bestScore = 0;
+    std::vector<size_t> positions;
+    size_t from = 0;
+    for (size_t attempts = 0; attempts < attemptLimit;) {
+        auto start = findEither(content, from, first, firstOtherCase);
+        if (start == std::string_view::npos) break;
+        auto lineEnd = std::min(content.find('\n', start), content.size());
+        auto limit = std::min(lineEnd, start + windowLimit);
+        auto nextFrom = limit == lineEnd ? lineEnd + 1 : start + 1; // matches don't go past the end of a line
+
+        // make sure the rest of the query fits at all before making a table
+        size_t row = 1, fits = start + 1;
+        for (; row < pattern.size() && fits < limit; fits++)
+            if (folded(content[fits], caseSensitive) == static_cast<unsigned char>(pattern[row])) row++;
+        if (row < pattern.size()) {
+            if (fits == content.size()) break; // starting any later can't fit it either
+            if (limit != lineEnd) attempts++; // giving up on a line goes straight to the next one, but trying again in a long line doesn't
+            from = nextFrom;
+            continue;
+        }
+        attempts++;
+
+        // the table only needs to go as far as the last place the query could end in this line
+        auto end = limit;
+        while (folded(content[end - 1], caseSensitive) != static_cast<unsigned char>(pattern.back()))
+            end--;
+
+        if (auto score = scoreWindow(content, start, end, pattern, caseSensitive, table, positions); score > bestScore) {
+            bestScore = score;
+            bestMatch = FuzzyMatch {static_cast<unsigned long>(std::min(1000, score * 1000 / perfect)), positions};
+            if (score >= perfect) break;
+        }
+        from = nextFrom;
+        if (from >= content.size()) break;
+    }
+    return bestMatch;
+}
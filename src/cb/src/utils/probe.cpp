@@ -0,0 +1,134 @@
+/*  The Clipboard Project - Cut, copy, and paste anything, anytime, anywhere, all from the terminal.
+    Copyright (C) 2023 Jackson Huff and other contributors on GitHub.com
+    SPDX-License-Identifier: GPL-3.0-or-later
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.*/
+#include "../clipboard.hpp"
+#include <fstream>
+
+#if defined(HAVE_LIBURING)
+#include <fcntl.h>
+#include <liburing.h>
+#include <sys/stat.h>
+#endif
+
+// Looking at lots of entries means lots of small stats and reads, each of which waits on the disk when nothing is cached.
+// Doing them all at once lets that waiting overlap, either through io_uring or through a few threads.
+
+static void probeFile(const fs::path& path, const size_t& headSize, FileProbe& probe) {
+    std::error_code ec;
+    auto status = fs::status(path, ec);
+    if (ec || !fs::exists(status)) return;
+    probe.exists = true;
+    probe.isDirectory = fs::is_directory(status);
+    probe.time = fs::last_write_time(path, ec).time_since_epoch().count();
+    if (probe.isDirectory) return;
+    probe.size = fs::file_size(path, ec);
+    std::ifstream input(path, std::ios::binary);
+    probe.head.resize(std::min<uint64_t>(headSize, probe.size));
+    input.read(probe.head.data(), probe.head.size());
+    probe.head.resize(input.gcount());
+}
+
+#if defined(HAVE_LIBURING)
+static bool probeWithRing(const std::vector<fs::path>& paths, const size_t& headSize, std::vector<FileProbe>& probes) {
+    constexpr unsigned filesInFlight = 64; // each one takes a statx, openat, read, and close
+    io_uring ring;
+    if (io_uring_queue_init(filesInFlight * 4, &ring, 0) < 0) return false;
+    // open straight into the ring's own file table so the read and close can be linked to the open without ever seeing a real fd
+    if (io_uring_register_files_sparse(&ring, filesInFlight) < 0) {
+        io_uring_queue_exit(&ring);
+        return false;
+    }
+
+    enum Step : uint64_t { Stat, Open, Read, Close };
+    std::vector<struct statx> stats(filesInFlight);
+    for (size_t first = 0; first < paths.size(); first += filesInFlight) {
+        auto count = std::min<size_t>(filesInFlight, paths.size() - first);
+        for (size_t slot = 0; slot < count; slot++) {
+            auto& probe = probes[first + slot];
+            probe.head.resize(headSize);
+
+            auto sqe = io_uring_get_sqe(&ring);
+            io_uring_prep_statx(sqe, AT_FDCWD, paths[first + slot].c_str(), 0, STATX_TYPE | STATX_SIZE | STATX_MTIME, &stats[slot]);
+            io_uring_sqe_set_data64(sqe, (slot << 2) | Stat);
+
+            sqe = io_uring_get_sqe(&ring);
+            io_uring_prep_openat_direct(sqe, AT_FDCWD, paths[first + slot].c_str(), O_RDONLY | O_CLOEXEC, 0, slot);
+            io_uring_sqe_set_data64(sqe, (slot << 2) | Open);
+            sqe->flags |= IOSQE_IO_LINK;
+
+            sqe = io_uring_get_sqe(&ring);
+            io_uring_prep_read(sqe, slot, probe.head.data(), probe.head.size(), 0);
+            io_uring_sqe_set_data64(sqe, (slot << 2) | Read);
+            sqe->flags |= IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK; // a short read or a directory still needs the close after it
+
+            sqe = io_uring_get_sqe(&ring);
+            io_uring_prep_close_direct(sqe, slot);
+            io_uring_sqe_set_data64(sqe, (slot << 2) | Close);
+        }
+
+        auto expected = count * 4;
+        io_uring_submit_and_wait(&ring, expected);
+        for (size_t seen = 0; seen < expected; seen++) {
+            io_uring_cqe* cqe;
+            if (io_uring_wait_cqe(&ring, &cqe) < 0) break;
+            auto data = io_uring_cqe_get_data64(cqe);
+            auto result = cqe->res;
+            io_uring_cqe_seen(&ring, cqe);
+            auto slot = data >> 2;
+            auto& probe = probes[first + slot];
+            if ((data & 3) == Stat && result == 0) {
+                const auto& stat = stats[slot];
+                probe.exists = true;
+                probe.isDirectory = S_ISDIR(stat.stx_mode);
+                probe.size = probe.isDirectory ? 0 : stat.stx_size;
+                auto modified = std::chrono::sys_time<std::chrono::nanoseconds>(std::chrono::seconds(stat.stx_mtime.tv_sec) + std::chrono::nanoseconds(stat.stx_mtime.tv_nsec));
+                probe.time = std::chrono::duration_cast<fs::file_time_type::duration>(std::chrono::file_clock::from_sys(modified).time_since_epoch()).count();
+            } else if ((data & 3) == Read)
+                probe.head.resize(std::max(result, 0));
+        }
+    }
+
+    for (auto& probe : probes)
+        if (!probe.exists) probe.head.clear();
+    io_uring_unregister_files(&ring);
+    io_uring_queue_exit(&ring);
+    return true;
+}
+#endif
+
+std::vector<FileProbe> probeFiles(const std::vector<fs::path>& paths, const size_t& headSize) {
+    std::vector<FileProbe> probes(paths.size());
+#if defined(HAVE_LIBURING)
+    if (probeWithRing(paths, headSize, probes)) return probes;
+    probes.assign(paths.size(), FileProbe());
+#endif
+    // threads mostly wait here instead of compute, so it's worth having a few even when there aren't many cores
+    auto totalThreads = std::min<size_t>(std::max(suitableThreadAmount(), 4u), paths.size() / 16);
+    if (totalThreads <= 1) {
+        for (size_t file = 0; file < paths.size(); file++)
+            probeFile(paths[file], headSize, probes[file]);
+        return probes;
+    }
+    std::atomic<size_t> next = 0;
+    std::vector<std::thread> threads;
+    for (size_t thread = 0; thread < totalThreads; thread++)
+        threads.emplace_back([&] {
+            for (auto file = next++; file < paths.size(); file = next++)
+                probeFile(paths[file], headSize, probes[file]);
+        });
+    for (auto& thread : threads)
+        thread.join();
+    return probes;
+}
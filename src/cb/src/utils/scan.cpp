@@ -0,0 +1,161 @@
+/*  The Clipboard Project - Cut, copy, and paste anything, anytime, anywhere, all from the terminal.
+    Copyright (C) 2023 Jackson Huff and other contributors on GitHub.com
+    SPDX-License-Identifier: GPL-3.0-or-later
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.*/
+#include "../clipboard.hpp"
+#include <bit>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define HAVE_X86_SIMD
+#endif
+
+// Looks for the first and last byte of the literal at the same time in a whole vector's worth of places, and only compares the rest where
+// both of them line up. Plain text queries almost never get that far, so this goes through content about as fast as it can be read.
+
+#if defined(HAVE_X86_SIMD)
+static size_t confirmedMatch(const std::string_view& haystack, const std::string_view& needle, const size_t& start, uint32_t candidates) {
+    for (; candidates != 0; candidates &= candidates - 1) {
+        auto position = start + std::countr_zero(candidates);
+        if (std::memcmp(haystack.data() + position + 1, needle.data() + 1, needle.size() - 2) == 0) return position;
+    }
+    return std::string_view::npos;
+}
+
+static size_t restOf(const std::string_view& haystack, const std::string_view& needle, const size_t& start) {
+    auto rest = haystack.substr(start).find(needle);
+    return rest == std::string_view::npos ? rest : start + rest;
+}
+
+static size_t sse2Find(const std::string_view& haystack, const std::string_view& needle) {
+    auto first = _mm_set1_epi8(needle.front());
+    auto last = _mm_set1_epi8(needle.back());
+    size_t start = 0;
+    for (; start + needle.size() - 1 + 16 <= haystack.size(); start += 16) {
+        auto atFirst = _mm_loadu_si128(reinterpret_cast<const __m128i*>(haystack.data() + start));
+        auto atLast = _mm_loadu_si128(reinterpret_cast<const __m128i*>(haystack.data() + start + needle.size() - 1));
+        auto candidates = static_cast<uint32_t>(_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, atFirst), _mm_cmpeq_epi8(last, atLast))));
+        if (auto position = confirmedMatch(haystack, needle, start, candidates); position != std::string_view::npos) return position;
+    }
+    return restOf(haystack, needle, start);
+}
+
+__attribute__((target("avx2"))) static size_t avx2Find(const std::string_view& haystack, const std::string_view& needle) {
+    auto first = _mm256_set1_epi8(needle.front());
+    auto last = _mm256_set1_epi8(needle.back());
+    size_t start = 0;
+    for (; start + needle.size() - 1 + 32 <= haystack.size(); start += 32) {
+        auto atFirst = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(haystack.data() + start));
+        auto atLast = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(haystack.data() + start + needle.size() - 1));
+        auto candidates = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(first, atFirst), _mm256_cmpeq_epi8(last, atLast))));
+        if (auto position = confirmedMatch(haystack, needle, start, candidates); position != std::string_view::npos) return position;
+    }
+    return restOf(haystack, needle, start);
+}
+#endif
+
+using Finder = size_t (*)(const std::string_view&, const std::string_view&);
+
+static const std::pair<std::string_view, Finder>& bestFinder() {
+    static const auto best = []() -> std::pair<std::string_view, Finder> {
+#if defined(HAVE_X86_SIMD)
+        if (__builtin_cpu_supports("avx2")) return {"avx2", avx2Find};
+        return {"sse2", sse2Find};
+#else
+        return {"scalar", [](const std::string_view& haystack, const std::string_view& needle) { return haystack.find(needle); }};
+#endif
+    }();
+    return best;
+}
+
+std::string_view literalScanner() {
+    return bestFinder().first;
+}
+
+size_t findLiteral(const std::string_view& haystack, const std::string_view& needle) {
+    if (needle.size() < 2 || haystack.size() < needle.size()) return haystack.find(needle); // one byte is memchr, which is already as fast as this gets
+    return bestFinder().second(haystack, needle);
+}
+
+// Aho-Corasick, made into a full table up front so that each byte of content is a single lookup
+LiteralAutomaton::LiteralAutomaton(const std::vector<std::string>& literals) {
+    for (const auto& literal : literals)
+        for (const auto& byte : literal)
+            if (classOf[static_cast<unsigned char>(byte)] == 0) classOf[static_cast<unsigned char>(byte)] = classes++;
+
+    // first the trie, where 0 in the table means there's no edge yet
+    std::vector<uint32_t> trie(classes, 0);
+    std::vector<std::vector<uint32_t>> endingHere(1);
+    for (uint32_t literal = 0; literal < literals.size(); literal++) {
+        uint32_t state = 0;
+        for (const auto& byte : literals[literal]) {
+            auto edge = state * classes + classOf[static_cast<unsigned char>(byte)];
+            if (trie[edge] == 0) {
+                trie[edge] = endingHere.size();
+                endingHere.emplace_back();
+                trie.resize(trie.size() + classes, 0);
+            }
+            state = trie[edge];
+        }
+        endingHere[state].emplace_back(literal);
+        lengths.emplace_back(literals[literal].size());
+    }
+
+    // then go breadth first so every state's failure link is done before anything that links through it
+    std::vector<uint32_t> failure(endingHere.size(), 0);
+    std::deque<uint32_t> queue;
+    for (size_t byteClass = 0; byteClass < classes; byteClass++)
+        if (trie[byteClass] != 0) queue.emplace_back(trie[byteClass]);
+    while (!queue.empty()) {
+        auto state = queue.front();
+        queue.pop_front();
+        const auto& inherited = endingHere[failure[state]];
+        endingHere[state].insert(endingHere[state].end(), inherited.begin(), inherited.end());
+        for (size_t byteClass = 0; byteClass < classes; byteClass++) {
+            auto& edge = trie[state * classes + byteClass];
+            if (edge != 0) {
+                failure[edge] = trie[failure[state] * classes + byteClass];
+                queue.emplace_back(edge);
+            } else
+                edge = trie[failure[state] * classes + byteClass];
+        }
+    }
+
+    next.resize(trie.size());
+    for (size_t edge = 0; edge < trie.size(); edge++)
+        next[edge] = trie[edge] * classes | (endingHere[trie[edge]].empty() ? 0 : 1u << 31);
+    for (const auto& literalsEndingHere : endingHere) {
+        endingStart.emplace_back(ending.size());
+        ending.insert(ending.end(), literalsEndingHere.begin(), literalsEndingHere.end());
+    }
+    endingStart.emplace_back(ending.size());
+}
+
+std::vector<size_t> LiteralAutomaton::firstPositions(const std::string_view& content) const {
+    std::vector<size_t> positions(lengths.size(), std::string_view::npos);
+    size_t remaining = lengths.size();
+    uint32_t row = 0;
+    for (size_t position = 0; position < content.size(); position++) {
+        auto edge = next[row + classOf[static_cast<unsigned char>(content[position])]];
+        row = edge & ~(1u << 31);
+        if (!(edge >> 31)) continue;
+        auto state = row / classes;
+        for (auto literal = endingStart[state]; literal < endingStart[state + 1]; literal++)
+            if (positions[ending[literal]] == std::string_view::npos) {
+                positions[ending[literal]] = position + 1 - lengths[ending[literal]];
+                if (--remaining == 0) return positions;
+            }
+    }
+    return positions;
+}
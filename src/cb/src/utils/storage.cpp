@@ -0,0 +1,516 @@
+/*  The Clipboard Project - Cut, copy, and paste anything, anytime, anywhere, all from the terminal.
+    Copyright (C) 2023 Jackson Huff and other contributors on GitHub.com
+    SPDX-License-Identifier: GPL-3.0-or-later
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.*/
+#include "../clipboard.hpp"
+#include <fstream>
+#include <openssl/evp.h>
+
+#if defined(HAVE_ZLIB)
+#include <zlib.h>
+#endif
+
+// Raw data can be stored in two other ways besides as-is, and both start with a magic and the size of the original content.
+// Compressed files continue with a zlib stream, and chunked files continue with a list of chunks in the clipboard's chunk store.
+// Plain content that happens to start with a magic gets escaped with a header of its own, so a magic always means that the content is encoded.
+constexpr std::string_view compressedMagic = "CBZLIB01";
+constexpr std::string_view chunkedMagic = "CBCHUNK1";
+constexpr std::string_view escapedMagic = "CBPLAIN1";
+
+enum class Encoding { Plain, Escaped, Compressed, Chunked };
+
+struct EncodedHeader {
+    std::array<char, 8> magic;
+    uint64_t originalSize;
+};
+
+struct ChunkReference {
+    uint64_t length;
+    std::array<unsigned char, 32> hash;
+};
+
+// A file to write the new version of some content into, which gets removed again unless it replaces that content
+struct TemporaryFile {
+    fs::path path;
+    bool replaced = false;
+    TemporaryFile(const fs::path& original, const std::string_view& suffix) : path(original) { path += suffix; }
+    ~TemporaryFile() {
+        std::error_code ec;
+        if (!replaced) fs::remove(path, ec);
+    }
+    void replace(const fs::path& original) {
+        fs::rename(path, original);
+        replaced = true;
+    }
+};
+
+static Encoding encodingOf(std::istream& input, EncodedHeader& header) {
+    input.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (input.gcount() == sizeof(header)) {
+        std::string_view magic(header.magic.data(), header.magic.size());
+        if (magic == compressedMagic) return Encoding::Compressed;
+        if (magic == chunkedMagic) return Encoding::Chunked;
+        if (magic == escapedMagic) return Encoding::Escaped;
+    }
+    input.clear();
+    input.seekg(0);
+    return Encoding::Plain;
+}
+
+static Encoding encodingOf(const fs::path& path) {
+    std::ifstream input(path, std::ios::binary);
+    EncodedHeader header;
+    return input.is_open() ? encodingOf(input, header) : Encoding::Plain;
+}
+
+static std::string hexOf(const std::array<unsigned char, 32>& hash) {
+    std::stringstream ss;
+    for (const auto& byte : hash)
+        ss << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(byte);
+    return ss.str();
+}
+
+static fs::path chunkStoreFor(const fs::path& rawData) {
+    return rawData.parent_path().parent_path().parent_path() / constants.objects_directory / constants.chunks_directory; // rawdata.clipboard is in data/<entry>/
+}
+
+// Every entry that uses a chunk has a hard link to it in a directory of its own, so the chunk's link count says how many entries use it
+// and releasing an entry only has to look at that entry's chunks.
+static fs::path chunkReferencesFor(const fs::path& chunkStore, const std::string& entryNumber) {
+    return chunkStore / constants.chunk_references_directory / entryNumber;
+}
+
+static void releaseReferences(const fs::path& chunkStore, const fs::path& references) {
+    std::error_code ec;
+    std::vector<fs::path> chunks;
+    for (const auto& reference : fs::directory_iterator(references, ec))
+        chunks.emplace_back(reference.path().filename());
+    for (const auto& chunk : chunks) {
+        fs::remove(references / chunk, ec);
+        if (fs::hard_link_count(chunkStore / chunk, ec) <= 1 && !ec) fs::remove(chunkStore / chunk, ec); // no more entries use this chunk
+    }
+    fs::remove_all(references, ec);
+}
+
+// Removes the chunk references in a new directory again unless they get kept
+struct NewChunkReferences {
+    fs::path chunkStore;
+    fs::path path;
+    bool kept = false;
+    ~NewChunkReferences() {
+        if (!kept) releaseReferences(chunkStore, path);
+    }
+};
+
+bool isEncodedFile(const fs::path& path) {
+    return encodingOf(path) != Encoding::Plain;
+}
+
+bool isChunkedFile(const fs::path& path) {
+    return encodingOf(path) == Encoding::Chunked;
+}
+
+bool isEncodedContent(const std::string_view& content) {
+    return content.starts_with(compressedMagic) || content.starts_with(chunkedMagic) || content.starts_with(escapedMagic);
+}
+
+std::string escapeHeaderFor(const std::string_view& head) {
+    if (!isEncodedContent(head)) return {};
+    EncodedHeader header;
+    std::copy(escapedMagic.begin(), escapedMagic.end(), header.magic.begin());
+    header.originalSize = 0; // escaped content can be appended to, so its size is always just the rest of the file
+    return std::string(reinterpret_cast<const char*>(&header), sizeof(header));
+}
+
+void escapeFile(const fs::path& path) {
+    std::ifstream input(path, std::ios::binary);
+    std::array<char, escapedMagic.size()> head;
+    input.read(head.data(), head.size());
+    auto header = escapeHeaderFor({head.data(), static_cast<size_t>(input.gcount())});
+    if (header.empty()) return;
+    input.clear();
+    input.seekg(0);
+    TemporaryFile temporary(path, ".escaped");
+    {
+        std::ofstream output(temporary.path, std::ios::binary | std::ios::trunc);
+        output << header << input.rdbuf();
+    }
+    temporary.replace(path);
+}
+
+uintmax_t originalFileSize(const fs::path& path) {
+    std::ifstream input(path, std::ios::binary);
+    EncodedHeader header;
+    auto encoding = encodingOf(input, header);
+    if (encoding == Encoding::Escaped) return fs::file_size(path) - sizeof(header);
+    if (encoding != Encoding::Plain) return header.originalSize;
+    return fs::file_size(path);
+}
+
+static std::vector<std::string> chunksReferencedBy(const fs::path& path) {
+    std::vector<std::string> chunks;
+    std::ifstream input(path, std::ios::binary);
+    EncodedHeader header;
+    if (encodingOf(input, header) != Encoding::Chunked) return chunks;
+    ChunkReference chunk;
+    while (input.read(reinterpret_cast<char*>(&chunk), sizeof(chunk)))
+        chunks.emplace_back(hexOf(chunk.hash));
+    return chunks;
+}
+
+uintmax_t storedFileSize(const fs::path& path) {
+    auto size = fs::file_size(path);
+    // chunked content is almost all in the chunk store, so its chunks count as part of it
+    std::error_code ec;
+    for (const auto& chunk : chunksReferencedBy(path))
+        if (auto chunkSize = fs::file_size(chunkStoreFor(path) / chunk, ec); !ec) size += chunkSize;
+    return size;
+}
+
+void streamFileContents(const fs::path& path, const std::function<bool(const std::string_view&)>& sink) {
+    std::ifstream input(path, std::ios::binary);
+    if (!input.is_open()) return;
+    std::vector<char> buffer(65536);
+    EncodedHeader header;
+    auto encoding = encodingOf(input, header);
+    if (encoding == Encoding::Chunked) {
+        ChunkReference chunk;
+        bool keepGoing = true;
+        while (keepGoing && input.read(reinterpret_cast<char*>(&chunk), sizeof(chunk))) {
+            auto chunkPath = chunkStoreFor(path) / hexOf(chunk.hash);
+            if (!fs::exists(chunkPath)) throw std::runtime_error("The chunk " + chunkPath.string() + " is missing");
+            streamFileContents(chunkPath, [&](const std::string_view& content) { return keepGoing = sink(content); });
+        }
+        return;
+    }
+#if defined(HAVE_ZLIB)
+    if (encoding == Encoding::Compressed) {
+        z_stream stream {};
+        if (inflateInit(&stream) != Z_OK) throw std::runtime_error("Couldn't start decompressing " + path.string());
+        std::vector<char> output(65536);
+        int status = Z_OK;
+        while (status != Z_STREAM_END && (input.read(buffer.data(), buffer.size()) || input.gcount() > 0)) {
+            stream.next_in = reinterpret_cast<Bytef*>(buffer.data());
+            stream.avail_in = input.gcount();
+            do {
+                stream.next_out = reinterpret_cast<Bytef*>(output.data());
+                stream.avail_out = output.size();
+                status = inflate(&stream, Z_NO_FLUSH);
+                if (status != Z_OK && status != Z_STREAM_END && status != Z_BUF_ERROR) {
+                    inflateEnd(&stream);
+                    throw std::runtime_error("Couldn't decompress " + path.string());
+                }
+                if (!sink({output.data(), output.size() - stream.avail_out})) {
+                    inflateEnd(&stream);
+                    return;
+                }
+            } while (stream.avail_out == 0);
+        }
+        inflateEnd(&stream);
+        return;
+    }
+#else
+    if (encoding == Encoding::Compressed) throw std::runtime_error("CB was built without compression support, so it can't read " + path.string());
+#endif
+    while (input.read(buffer.data(), buffer.size()) || input.gcount() > 0)
+        if (!sink({buffer.data(), static_cast<size_t>(input.gcount())})) return;
+}
+
+std::string fileHead(const fs::path& path, const size_t& length) {
+#if defined(__linux__) || defined(__unix__) || defined(__APPLE__)
+    // plain files only need the bytes we're going to look at, in a single read
+    int fd = open(path.string().data(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return {};
+    std::string head(std::max(length, sizeof(EncodedHeader)), '\0');
+    ssize_t bytesRead;
+    do
+        bytesRead = pread(fd, head.data(), head.size(), 0);
+    while (bytesRead == -1 && errno == EINTR);
+    close(fd);
+    head.resize(std::max<ssize_t>(bytesRead, 0));
+    if (!isEncodedContent(head)) {
+        if (head.size() > length) head.resize(length);
+        return head;
+    }
+    head.clear();
+#else
+    std::string head;
+#endif
+    streamFileContents(path, [&](const std::string_view& chunk) {
+        head.append(chunk.substr(0, length - head.size()));
+        return head.size() < length;
+    });
+    return head;
+}
+
+std::string decodedContents(const fs::path& path, const std::string_view& content) {
+    if (content.size() < sizeof(EncodedHeader)) return std::string(content);
+    if (content.starts_with(escapedMagic)) return std::string(content.substr(sizeof(EncodedHeader)));
+    if (content.starts_with(chunkedMagic)) {
+        std::string output;
+        streamFileContents(path, [&](const std::string_view& chunk) {
+            output.append(chunk);
+            return true;
+        });
+        return output;
+    }
+    if (!content.starts_with(compressedMagic)) return std::string(content);
+#if defined(HAVE_ZLIB)
+    EncodedHeader header;
+    std::memcpy(&header, content.data(), sizeof(header));
+    std::string output(header.originalSize, '\0');
+    uLongf outputSize = output.size();
+    if (uncompress(reinterpret_cast<Bytef*>(output.data()), &outputSize, reinterpret_cast<const Bytef*>(content.data() + sizeof(header)), content.size() - sizeof(header)) != Z_OK)
+        throw std::runtime_error("Couldn't decompress " + path.string());
+    output.resize(outputSize);
+    return output;
+#else
+    throw std::runtime_error("CB was built without compression support, so it can't read " + path.string());
+#endif
+}
+
+void decodeFile(const fs::path& path, const bool& keepEscaped) {
+    auto encoding = encodingOf(path);
+    if (encoding == Encoding::Plain || (encoding == Encoding::Escaped && keepEscaped)) return;
+    TemporaryFile temporary(path, ".decoded");
+    {
+        std::ofstream output(temporary.path, std::ios::binary | std::ios::trunc);
+        streamFileContents(path, [&](const std::string_view& chunk) { return static_cast<bool>(output.write(chunk.data(), chunk.size())); });
+    }
+    if (keepEscaped) escapeFile(temporary.path);
+    temporary.replace(path);
+}
+
+static bool isAlreadyCompressed(const std::string_view& type) {
+    constexpr std::array<std::string_view, 14> compressedTypes {
+            "application/zip",
+            "application/gzip",
+            "application/x-xz",
+            "application/zstd",
+            "application/x-bzip2",
+            "application/bzip2",
+            "application/x-lz4",
+            "application/x-7z-compressed",
+            "application/java-archive",
+            "application/epub+zip",
+            "application/vnd.android.package-archive",
+            "application/x-rpm",
+            "application/vnd.debian.binary-package",
+            "application/pdf"};
+    constexpr std::array<std::string_view, 7> uncompressedMedia {"image/svg+xml", "image/bmp", "image/tiff", "image/x-portable-graymap", "image/x-rgb", "audio/x-wav", "audio/basic"};
+    if (std::find(compressedTypes.begin(), compressedTypes.end(), type) != compressedTypes.end()) return true;
+    if (type.starts_with("image/") || type.starts_with("audio/") || type.starts_with("video/"))
+        return std::find(uncompressedMedia.begin(), uncompressedMedia.end(), type) == uncompressedMedia.end();
+    return false;
+}
+
+bool compressFile(const fs::path& path) {
+#if defined(HAVE_ZLIB)
+    constexpr uintmax_t smallestWorthCompressing = 512;
+    std::error_code ec;
+    auto originalSize = fs::file_size(path, ec);
+    if (ec || originalSize < smallestWorthCompressing || isEncodedFile(path)) return false;
+    if (auto type = inferMIMEType(fileHead(path, constants.preview_head_size)); type && isAlreadyCompressed(type.value())) return false;
+
+    TemporaryFile temporary(path, ".compressed");
+    {
+        std::ifstream input(path, std::ios::binary);
+        std::ofstream output(temporary.path, std::ios::binary | std::ios::trunc);
+        EncodedHeader header;
+        std::copy(compressedMagic.begin(), compressedMagic.end(), header.magic.begin());
+        header.originalSize = originalSize;
+        output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+        z_stream stream {};
+        if (deflateInit(&stream, Z_DEFAULT_COMPRESSION) != Z_OK) return false;
+        std::vector<char> buffer(65536), compressed(65536);
+        int flush = Z_NO_FLUSH, status = Z_OK;
+        do {
+            input.read(buffer.data(), buffer.size());
+            stream.next_in = reinterpret_cast<Bytef*>(buffer.data());
+            stream.avail_in = input.gcount();
+            flush = input.eof() ? Z_FINISH : Z_NO_FLUSH;
+            do {
+                stream.next_out = reinterpret_cast<Bytef*>(compressed.data());
+                stream.avail_out = compressed.size();
+                status = deflate(&stream, flush);
+                output.write(compressed.data(), compressed.size() - stream.avail_out);
+            } while (stream.avail_out == 0 && status != Z_STREAM_ERROR);
+        } while (flush != Z_FINISH && status != Z_STREAM_ERROR && !input.bad());
+        deflateEnd(&stream);
+        // a short write (like when the disk is full) would leave compressed content that's missing its end
+        output.close();
+        if (status != Z_STREAM_END || input.bad() || !output) return false;
+    }
+
+    // only keep the compressed version if it's actually worth it
+    if (fs::file_size(temporary.path) > originalSize - originalSize / 8) return false;
+    temporary.replace(path);
+    return true;
+#else
+    return false;
+#endif
+}
+
+// FastCDC (Xia et al., 2016) with normalized chunking: cut points come from a rolling gear hash, so an edit only changes the chunks around it
+// and everything else in the content still lines up with chunks that are already stored.
+static const std::array<uint64_t, 256> gearTable = [] {
+    std::array<uint64_t, 256> table;
+    uint64_t state = 0x9e3779b97f4a7c15; // fixed seed, since changing the table would change every cut point
+    for (auto& entry : table) {
+        state += 0x9e3779b97f4a7c15;
+        auto mixed = state;
+        mixed = (mixed ^ (mixed >> 30)) * 0xbf58476d1ce4e5b9;
+        mixed = (mixed ^ (mixed >> 27)) * 0x94d049bb133111eb;
+        entry = mixed ^ (mixed >> 31);
+    }
+    return table;
+}();
+
+// every chunk is a file of its own, so they're big enough that even huge content only needs a few hundred of them
+constexpr size_t minimumChunkLength = 256 * 1024;
+constexpr size_t averageChunkLength = 1024 * 1024;
+constexpr size_t maximumChunkLength = 4 * 1024 * 1024;
+
+// spreads the bits out over the top of the hash, since those bits depend on the most bytes
+static constexpr uint64_t spreadMask(const int& bits) {
+    uint64_t mask = 0;
+    for (int i = 0; i < bits; i++)
+        mask |= uint64_t(1) << (63 - i * 2);
+    return mask;
+}
+
+static size_t chunkLength(const std::string_view& content) {
+    constexpr uint64_t smallMask = spreadMask(22); // 2 bits more than the average needs, to make chunks shorter than the average less likely
+    constexpr uint64_t largeMask = spreadMask(18); // 2 bits fewer than the average needs, to make chunks longer than the average less likely
+
+    size_t length = std::min(content.size(), maximumChunkLength);
+    if (length <= minimumChunkLength) return length;
+    size_t normalLength = std::min(length, averageChunkLength);
+    uint64_t hash = 0;
+    size_t i = minimumChunkLength;
+    for (; i < normalLength; i++) {
+        hash = (hash << 1) + gearTable[static_cast<unsigned char>(content[i])];
+        if (!(hash & smallMask)) return i;
+    }
+    for (; i < length; i++) {
+        hash = (hash << 1) + gearTable[static_cast<unsigned char>(content[i])];
+        if (!(hash & largeMask)) return i;
+    }
+    return i;
+}
+
+static bool chunkFile(const fs::path& path, const bool& compressChunks) {
+    std::error_code ec;
+    auto originalSize = fs::file_size(path, ec);
+    if (ec || isEncodedFile(path)) return false;
+
+    auto chunkStore = chunkStoreFor(path);
+    fs::create_directories(chunkStore);
+
+    auto references = chunkReferencesFor(chunkStore, path.parent_path().filename().string()); // rawdata.clipboard is in data/<entry>/
+    NewChunkReferences newReferences {chunkStore, references.string() + "." + std::to_string(thisPID())};
+    releaseReferences(chunkStore, newReferences.path); // left over from a process that didn't finish
+    fs::create_directories(newReferences.path);
+
+    TemporaryFile temporary(path, ".chunked");
+    std::ofstream manifest(temporary.path, std::ios::binary | std::ios::trunc);
+    EncodedHeader header;
+    std::copy(chunkedMagic.begin(), chunkedMagic.end(), header.magic.begin());
+    header.originalSize = originalSize;
+    manifest.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    auto storeChunk = [&](const std::string_view& chunk) {
+        ChunkReference reference {chunk.size(), {}};
+        unsigned int hashLength = 0;
+        EVP_Digest(chunk.data(), chunk.size(), reference.hash.data(), &hashLength, EVP_sha256(), nullptr);
+        if (auto chunkPath = chunkStore / hexOf(reference.hash); !fs::exists(chunkPath)) {
+            TemporaryFile partial(chunkPath, "." + std::to_string(thisPID()));
+            std::ofstream stream(partial.path, std::ios::binary | std::ios::trunc);
+            stream << escapeHeaderFor(chunk) << chunk;
+            stream.close();
+            // later content gets deduplicated against whatever is stored under this hash, so it has to be all there
+            if (!stream) throw fs::filesystem_error("Couldn't store a chunk", partial.path, std::make_error_code(std::errc::io_error));
+            if (compressChunks) compressFile(partial.path);
+            partial.replace(chunkPath);
+        }
+        if (auto link = newReferences.path / hexOf(reference.hash); !fs::exists(link)) fs::create_hard_link(chunkStore / hexOf(reference.hash), link);
+        manifest.write(reinterpret_cast<const char*>(&reference), sizeof(reference));
+    };
+
+    std::ifstream input(path, std::ios::binary);
+    std::string window;
+    std::vector<char> buffer(1024 * 1024);
+    size_t start = 0;
+    while (input.read(buffer.data(), buffer.size()) || input.gcount() > 0) {
+        window.erase(0, start);
+        start = 0;
+        window.append(buffer.data(), input.gcount());
+        while (window.size() - start >= maximumChunkLength) { // only cut once a whole maximum-size chunk is available so the cut doesn't depend on how the file was read
+            auto length = chunkLength(std::string_view(window).substr(start));
+            storeChunk(std::string_view(window).substr(start, length));
+            start += length;
+        }
+    }
+    while (start < window.size()) {
+        auto length = chunkLength(std::string_view(window).substr(start));
+        storeChunk(std::string_view(window).substr(start, length));
+        start += length;
+    }
+    manifest.close();
+    if (!manifest || input.bad()) throw fs::filesystem_error("Couldn't chunk", path, std::make_error_code(std::errc::io_error));
+    // the new references hold on to every chunk the content needs, so whatever this entry referred to before can go first
+    releaseReferences(chunkStore, references);
+    fs::rename(newReferences.path, references);
+    newReferences.kept = true;
+    temporary.replace(path);
+    return true;
+}
+
+bool Clipboard::compressesContent() {
+#if defined(HAVE_ZLIB)
+    static auto setting = getenv("CLIPBOARD_COMPRESS");
+    if (setting == nullptr) return false;
+    if (envVarIsTrue("CLIPBOARD_COMPRESS")) return is_persistent;
+    for (const auto& pattern : regexSplit(setting, std::regex(" ")))
+        if (std::regex_match(this_name, std::regex(pattern))) return true;
+#endif
+    return false;
+}
+
+void Clipboard::compressCurrentEntry() {
+    if (!compressesContent() || !holdsRawDataInCurrentEntry()) return;
+    try {
+        compressFile(data.raw);
+    } catch (const fs::filesystem_error& e) {} // leaving the content uncompressed is always fine
+}
+
+void Clipboard::chunkCurrentEntry() {
+    std::error_code ec;
+    if (auto size = fs::file_size(data.raw, ec); ec || size < constants.chunking_threshold) return;
+    try {
+        chunkFile(data.raw, compressesContent());
+    } catch (const fs::filesystem_error& e) {}
+}
+
+void Clipboard::releaseChunksOf(const unsigned long& entryNumber) {
+    auto chunkStore = objects / constants.chunks_directory;
+    releaseReferences(chunkStore, chunkReferencesFor(chunkStore, std::to_string(entryNumber)));
+}
+
+void Clipboard::moveChunkReferences(const unsigned long& from, const unsigned long& to) {
+    auto chunkStore = objects / constants.chunks_directory;
+    std::error_code ec;
+    fs::rename(chunkReferencesFor(chunkStore, std::to_string(from)), chunkReferencesFor(chunkStore, std::to_string(to)), ec); // entries that aren't chunked have none
+}
@@ -52,7 +52,12 @@ bool progress_silent = false;
 bool confirmation_silent = false;
 bool no_color = false;
 bool all_option = false;
+bool contents_option = false;
 bool secret_selection = false;
+size_t limit_option = 0;
+size_t offset_option = 0;
+std::optional<std::chrono::seconds> since_option;
+std::optional<std::chrono::seconds> until_option;
 
 std::string maximumHistorySize;
 
@@ -109,6 +114,32 @@ bool envVarIsTrue(const std::string_view& name) {
     return false;
 }
 
+std::optional<std::chrono::seconds> parsedDuration(const std::string_view& duration) {
+    // the same units as CLIPBOARD_HISTORY: y(ears), m(onths), w(eeks), d(ays), h(ours), s(econds)
+    if (duration.empty()) return std::nullopt;
+    try {
+        auto amount = std::stold(std::string(duration));
+        switch (std::tolower(static_cast<unsigned char>(duration.back()))) {
+        case 'y':
+            return std::chrono::seconds(static_cast<long long>(amount * 60.0 * 60.0 * 24.0 * 365.0));
+        case 'm':
+            return std::chrono::seconds(static_cast<long long>(amount * 60.0 * 60.0 * 24.0 * 30.0));
+        case 'w':
+            return std::chrono::seconds(static_cast<long long>(amount * 60.0 * 60.0 * 24.0 * 7.0));
+        case 'd':
+            return std::chrono::seconds(static_cast<long long>(amount * 60.0 * 60.0 * 24.0));
+        case 'h':
+            return std::chrono::seconds(static_cast<long long>(amount * 60.0 * 60.0));
+        case 's':
+            return std::chrono::seconds(static_cast<long long>(amount));
+        default:
+            return std::nullopt;
+        }
+    } catch (...) {
+        return std::nullopt;
+    }
+}
+
 std::vector<std::string> regexSplit(const std::string& content, const std::regex& regex) {
     std::sregex_token_iterator begin(content.begin(), content.end(), regex, -1), end; // -1: return the things that are not matched
     return std::vector<std::string>(begin, end);
@@ -142,6 +173,82 @@ std::string pipedInContent(bool count) {
     return content;
 }
 
+std::string pipeInToFile(const fs::path& path) {
+#if defined(__linux__) || defined(__unix__) || defined(__APPLE__)
+    writeToFile(path, ""); // so that we never write through a hard link to shared content
+    int output = open(path.string().data(), O_WRONLY | O_TRUNC | O_CLOEXEC);
+    if (output == -1) throw fs::filesystem_error("Couldn't open", path, std::error_code(errno, std::generic_category()));
+    auto fail = [&] {
+        auto error = errno;
+        close(output);
+        throw fs::filesystem_error("Couldn't pipe into", path, std::error_code(error, std::generic_category()));
+    };
+    auto writeAll = [&](const char* data, size_t length) {
+        while (length > 0) {
+            auto written = write(output, data, length);
+            if (written == -1) {
+                if (errno == EINTR) continue;
+                fail();
+            }
+            data += written;
+            length -= written;
+        }
+    };
+
+    // keep the first part around for things like MIME type detection, and only that part so that huge input never has to fit in memory
+    int stdinFd = fileno(stdin);
+    std::string head;
+    std::array<char, 65536> buffer;
+    ssize_t len = -1;
+    while (head.size() < constants.piped_head_size && len != 0) {
+        len = read(stdinFd, buffer.data(), std::min(buffer.size(), constants.piped_head_size - head.size()));
+        if (len == -1) {
+            if (errno == EINTR) continue;
+            fail();
+        }
+        head.append(buffer.data(), len);
+        successes.bytes += len;
+    }
+    if (path.filename() == constants.data_file_name) {
+        auto header = escapeHeaderFor(head); // so that plain content never gets mistaken for encoded content
+        writeAll(header.data(), header.size());
+    }
+    writeAll(head.data(), head.size());
+
+#if defined(__linux__)
+    // move everything else straight from stdin to the file inside the kernel
+    struct stat info;
+    bool kernelCanCopy = fstat(stdinFd, &info) == 0 && (S_ISFIFO(info.st_mode) || S_ISREG(info.st_mode));
+    while (len != 0 && kernelCanCopy) {
+        len = S_ISFIFO(info.st_mode) ? splice(stdinFd, nullptr, output, nullptr, 1024 * 1024, SPLICE_F_MOVE | SPLICE_F_MORE)
+                                     : copy_file_range(stdinFd, nullptr, output, nullptr, 1024 * 1024, 0);
+        if (len > 0) successes.bytes += len;
+        if (len != -1) continue;
+        if (errno == EINTR) continue;
+        if (errno != EINVAL && errno != ENOSYS && errno != EXDEV && errno != EOPNOTSUPP) fail();
+        kernelCanCopy = false; // the filesystem doesn't support it, so do it ourselves
+        len = -1;
+    }
+#endif
+
+    while (len != 0) {
+        len = read(stdinFd, buffer.data(), buffer.size());
+        if (len == -1) {
+            if (errno == EINTR) continue;
+            fail();
+        }
+        writeAll(buffer.data(), len);
+        successes.bytes += len;
+    }
+    close(output);
+    return head;
+#else
+    auto content = pipedInContent();
+    writeToFile(path, content);
+    return content.substr(0, constants.piped_head_size);
+#endif
+}
+
 unsigned int suitableThreadAmount() {
     auto maxThreads = std::thread::hardware_concurrency();
     if (maxThreads < 4) return 1;
@@ -414,13 +521,19 @@ Action getAction() {
             }
         }
         auto possible_action = arguments.at(0);
-        auto lowest_distance_action =
-                *(std::min_element(actions.begin(), actions.end(), [&](const auto& a, const auto& b) { return levenshteinDistance(possible_action, a) < levenshteinDistance(possible_action, b); }));
-        auto lowest_distance_for_action = levenshteinDistance(possible_action, lowest_distance_action);
-        auto lowest_distance_shortcut = *(std::min_element(action_shortcuts.begin(), action_shortcuts.end(), [&](const auto& a, const auto& b) {
-            return levenshteinDistance(possible_action, a) < levenshteinDistance(possible_action, b);
-        }));
-        auto lowest_distance_for_shortcut = levenshteinDistance(possible_action, lowest_distance_shortcut);
+        // only suggestions within 2 edits get shown, so there's no point in working out exactly how far anything else is
+        auto closest = [&](const auto& candidates) {
+            std::string best;
+            unsigned long bestDistance = 3;
+            for (const auto& candidate : candidates)
+                if (auto distance = levenshteinDistance(possible_action, candidate, 2); distance < bestDistance) {
+                    best = candidate;
+                    bestDistance = distance;
+                }
+            return std::make_pair(best, bestDistance);
+        };
+        auto [lowest_distance_action, lowest_distance_for_action] = closest(actions);
+        auto [lowest_distance_shortcut, lowest_distance_for_shortcut] = closest(action_shortcuts);
         auto lowest_distance = std::min(lowest_distance_for_action, lowest_distance_for_shortcut);
         auto lowest_distance_candidate = lowest_distance_for_shortcut < lowest_distance_for_action ? lowest_distance_shortcut : lowest_distance_action;
         clipboard_state = ClipboardState::Error;
@@ -456,6 +569,7 @@ IOType getIOType() {
 
 void setFlags() {
     if (flagIsPresent<bool>("--all") || flagIsPresent<bool>("-a")) all_option = true;
+    if (flagIsPresent<bool>("--contents")) contents_option = true;
     if (flagIsPresent<bool>("--fast-copy") || flagIsPresent<bool>("-fc")) copying.use_safe_copy = false;
     if (auto flag = flagIsPresent<std::string>("--mime"); flag != "") preferred_mime = flag;
     if (auto flag = flagIsPresent<std::string>("-m"); flag != "") preferred_mime = flag;
@@ -478,6 +592,14 @@ void setFlags() {
     if (auto flag = flagIsPresent<std::string>("--entry"); flag != "") try {
             clipboard_entry = std::stoul(flag);
         } catch (...) {}
+    if (auto flag = flagIsPresent<std::string>("--limit"); flag != "") try {
+            limit_option = std::stoul(flag);
+        } catch (...) {}
+    if (auto flag = flagIsPresent<std::string>("--offset"); flag != "") try {
+            offset_option = std::stoul(flag);
+        } catch (...) {}
+    if (auto flag = flagIsPresent<std::string>("--since"); flag != "") since_option = parsedDuration(flag);
+    if (auto flag = flagIsPresent<std::string>("--until"); flag != "") until_option = parsedDuration(flag);
     if (flagIsPresent<bool>("-h") || flagIsPresent<bool>("help", "--")) {
         auto longestAction = columnLength(*(std::max_element(actions.begin(), actions.end(), [](const auto& a, const auto& b) { return columnLength(a) < columnLength(b); })));
         auto longestActionShortcut = columnLength(*std::max_element(action_shortcuts.begin(), action_shortcuts.end(), [](const auto& a, const auto& b) { return columnLength(a) < columnLength(b); }));
@@ -534,10 +656,13 @@ void fixMissingItems() {
             std::vector<std::string> candidates;
             for (const auto& entry : fs::directory_iterator(item.parent_path().empty() ? fs::current_path() : item.parent_path()))
                 candidates.emplace_back(entry.path().filename().string());
-            auto closestCandidate = *(std::min_element(candidates.begin(), candidates.end(), [&](const auto& a, const auto& b) {
-                return levenshteinDistance(a, item.filename().string()) < levenshteinDistance(b, item.filename().string());
-            }));
-            auto closestScore = levenshteinDistance(closestCandidate, item.filename().string());
+            std::string closestCandidate;
+            unsigned long closestScore = 3;
+            for (const auto& candidate : candidates)
+                if (auto score = levenshteinDistance(candidate, item.filename().string(), 2); score < closestScore) {
+                    closestCandidate = candidate;
+                    closestScore = score;
+                }
             if (closestScore >= 3) continue;
             stopIndicator();
             fprintf(stderr,
@@ -564,7 +689,7 @@ void checkForNoItems() {
     if (action_is_one_of(Cut, Copy, Add, Remove) && io_type != IOType::Pipe && copying.items.size() < 1) {
         error_exit(choose_action_items_message(), actions[action], actions[action], clipboard_invocation, actions[action]);
     }
-    if (((action_is_one_of(Paste, Show) || (action == Clear && !all_option))) && (!fs::exists(path.data) || fs::is_empty(path.data))) {
+    if (((action_is_one_of(Paste, Show) || (action == Clear && !all_option))) && !path.isPacked(path.entry()) && (!fs::exists(path.data) || fs::is_empty(path.data))) {
         PerformAction::status();
         exit(EXIT_SUCCESS);
     }
@@ -585,7 +710,7 @@ unsigned long long totalItemSize() {
             }
         }
     } else if (action == Action::Paste && io_type == IOType::File)
-        total_item_size += totalDirectorySize(path.data);
+        total_item_size += path.isPacked(path.entry()) ? path.recordFor(path.entry()).bytes : totalDirectorySize(path.data);
     return total_item_size;
 }
 
@@ -706,6 +831,9 @@ std::string getMIMEType() {
     if (io_type == IOType::File) {
         return "text/uri-list";
     } else if (io_type == IOType::Pipe || io_type == IOType::Text) {
+        if (copying.buffer.empty() && path.isPacked(path.entry()))
+            return std::string(inferMIMEType(path.rawDataFor(path.entry()).content().substr(0, constants.piped_head_size)).value_or("text/plain"));
+        if (copying.buffer.empty() && path.holdsRawDataInCurrentEntry()) return std::string(inferMIMEType(fileHead(path.data.raw, constants.piped_head_size)).value_or("text/plain"));
         return std::string(inferMIMEType(copying.buffer).value_or("text/plain"));
     }
     return "text/plain";
@@ -0,0 +1,23 @@
+#!/bin/sh
+. ./resources.sh
+export CLIPBOARD_FORCETTY=1
+start_test "Report items that couldn't be copied"
+
+if ! command -v mkfifo > /dev/null
+then
+    exit 0
+fi
+
+make_files
+
+mkfifo testdir/testpipe
+
+assert_fails cb copy14 testdir testfile
+
+item_is_in_cb 14 testfile
+
+item_is_in_cb 14 testdir/testfile
+
+output="$(cb copy14 testdir testfile 2>&1 || true)"
+
+content_is_shown "$output" "testdir"
@@ -0,0 +1,44 @@
+#!/bin/sh
+. ./resources.sh
+start_test "Store encoded and plain content"
+
+export CLIPBOARD_COMPRESS="15"
+
+compressible="$(yes "Compressible text" | head -n 1000)"
+
+printf "%s" "$compressible" | cb copy15
+
+assert_equals "$compressible" "$(cb paste15 | cat)"
+
+printf "CBZLIB01%s" "$compressible" | cb copy15
+
+assert_equals "CBZLIB01$compressible" "$(cb paste15 | cat)"
+
+cb copy16 "CBZLIB01 isn't compressed"
+
+assert_equals "CBZLIB01 isn't compressed" "$(cb paste16 | cat)"
+
+printf "%s" "CBCHUNK1 isn't chunked" | cb copy16
+
+assert_equals "CBCHUNK1 isn't chunked" "$(cb paste16 | cat)"
+
+cb copy16 "CB"
+
+cb add16 "PLAIN1 isn't escaped"
+
+assert_equals "CBPLAIN1 isn't escaped" "$(cb paste16 | cat)"
+
+assert_equals "CBZLIB01 isn't compressed" "$(cb paste16 -e 2 | cat)"
+
+chunked="$(yes "Chunked text" | head -c 9000000 | cksum)"
+
+yes "Chunked text" | head -c 9000000 | cb copy18
+
+if [ ! -d "$CLIPBOARD_TMPDIR"/Clipboard/18/objects/chunks ]
+then
+    fail "😕 The big content wasn't chunked"
+fi
+
+assert_equals "$chunked" "$(cb paste18 | cksum)"
+
+unset CLIPBOARD_COMPRESS
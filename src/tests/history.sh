@@ -44,4 +44,55 @@ content_is_shown "$json" '"content": "Some text 3"'
 
 content_is_shown "$json" '"content": "Some text 4"'
 
-content_is_shown "$json" '"content": "Some text 5"'
\ No newline at end of file
+content_is_shown "$json" '"content": "Some text 5"'
+
+json="$(cb history --limit 2 --offset 1 2>&1)"
+
+content_is_shown "$json" '"content": "Some text 4"'
+
+content_is_shown "$json" '"content": "Some text 3"'
+
+assert_equals "$(printf "%s" "$json" | grep -c '"content"')" "2"
+
+json="$(cb history --until 1d 2>&1)"
+
+assert_equals "$(printf "%s" "$json" | grep -c '"content"')" "0"
+
+cb copy2 "Other text"
+
+json="$(cb history --all --limit 2 2>&1)"
+
+content_is_shown "$json" '"clipboard": "2"'
+
+content_is_shown "$json" '"content": "Other text"'
+
+content_is_shown "$json" '"content": "Some text 5"'
+
+cb copy6 "Queued up again"
+
+cb copy6 "Copied long ago"
+
+touch -d "2 days ago" "$CLIPBOARD_TMPDIR"/Clipboard/6/data/2
+
+rm "$CLIPBOARD_TMPDIR"/Clipboard/6/metadata/index
+
+json="$(cb history --all --since 1d 2>&1)"
+
+content_is_shown "$json" '"content": "Queued up again"'
+
+assert_equals "$(printf "%s" "$json" | grep -c '"content": "Copied long ago"')" "0"
+
+export CLIPBOARD_HISTORY=20mb
+
+for entry in 1 2 3 4
+do
+    yes "Chunked entry $entry" | head -c 9000000 | cb copy26
+done
+
+assert_equals "3 4" "$(ls "$CLIPBOARD_TMPDIR"/Clipboard/26/data | sort -n | xargs)"
+
+assert_equals "3 4" "$(ls "$CLIPBOARD_TMPDIR"/Clipboard/26/objects/chunks/references | sort -n | xargs)"
+
+assert_equals "" "$(find "$CLIPBOARD_TMPDIR"/Clipboard/26/objects/chunks -maxdepth 1 -type f -links 1)"
+
+unset CLIPBOARD_HISTORY
@@ -0,0 +1,57 @@
+#!/bin/sh
+. ./resources.sh
+start_test "Load into deduplicated clipboards"
+
+export CLIPBOARD_COMPRESS="10 11"
+
+shared="$(yes "Shared text" | head -n 200)"
+
+loaded="$(yes "Loaded text" | head -n 200)"
+
+printf "%s" "$shared" | cb copy10
+
+cb copy10 "Other text"
+
+printf "%s" "$shared" | cb copy10
+
+printf "%s" "$loaded" | cb copy11
+
+cb load11 10
+
+assert_equals "$shared" "$(cb paste10 -e 2 | cat)"
+
+assert_equals "$loaded" "$(cb paste10 | cat)"
+
+cb copy12 "Shared text"
+
+cb copy12 "Other text"
+
+cb copy12 "Shared text"
+
+cb copy13 "Loaded text"
+
+cb load13 12 --fast-copy
+
+cb add12 " and more"
+
+assert_equals "Shared text" "$(cb paste12 -e 2 | cat)"
+
+assert_equals "Loaded text and more" "$(cb paste12 | cat)"
+
+assert_equals "Loaded text" "$(cb paste13 | cat)"
+
+unset CLIPBOARD_COMPRESS
+
+echo "Foobar" > file1
+
+echo "Foobar" > file2
+
+cb copy27 file1 file2
+
+cb copy27 file1 file2
+
+entry="$(ls "$CLIPBOARD_TMPDIR"/Clipboard/27/data | sort -n | tail -n 1)"
+
+assert_equals "file1 file2" "$(ls -A "$CLIPBOARD_TMPDIR"/Clipboard/27/data/"$entry" | xargs)"
+
+assert_equals "5 5" "$(stat -c %h "$CLIPBOARD_TMPDIR"/Clipboard/27/data/"$entry"/file1 "$CLIPBOARD_TMPDIR"/Clipboard/27/data/"$entry"/file2 | xargs)"
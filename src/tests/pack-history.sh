@@ -0,0 +1,54 @@
+#!/bin/sh
+. ./resources.sh
+start_test "Pack history entries"
+
+export CLIPBOARD_PACKHISTORY=1
+
+cb copy1 "Packed text 1"
+
+cb copy1 "Packed text 2"
+
+cb copy1 "Packed text 3"
+
+cb copy1 "Packed text 4"
+
+if [ ! -f "$CLIPBOARD_TMPDIR"/Clipboard/1/packs/table ]
+then
+    fail "😕 The older entries weren't packed"
+fi
+
+table="$(cksum < "$CLIPBOARD_TMPDIR"/Clipboard/1/packs/table)"
+
+json="$(cb history1 2>&1)"
+
+content_is_shown "$json" '"content": "Packed text 1"'
+
+content_is_shown "$json" '"content": "Packed text 4"'
+
+assert_equals "Packed text 2" "$(cb paste1 -e 2 | cat)"
+
+cb search1 "Packed text" > /dev/null 2>&1
+
+assert_equals "$table" "$(cksum < "$CLIPBOARD_TMPDIR"/Clipboard/1/packs/table)"
+
+export CLIPBOARD_COMPRESS="17"
+
+compressible="$(yes "Packed and compressed text" | head -n 1000)"
+
+for i in 1 2 3 4
+do
+    printf "%s %s" "$compressible" "$i" | cb copy17
+done
+
+if [ "$(cat "$CLIPBOARD_TMPDIR"/Clipboard/17/packs/*.pack | wc -c)" -gt 10000 ]
+then
+    fail "😕 The packed entries weren't kept compressed"
+fi
+
+content_is_shown "$(cb history17 2>&1)" "Packed and compressed text 2"
+
+assert_equals "$compressible 2" "$(cb paste17 -e 2 | cat)"
+
+unset CLIPBOARD_COMPRESS
+
+unset CLIPBOARD_PACKHISTORY
@@ -17,4 +17,19 @@ item_exists testdir/testfile
 
 cb clear
 
-cb paste
\ No newline at end of file
+cb paste
+cd ..
+
+echo "New content" > linkedfile
+
+cb copy19 linkedfile
+
+setup_dir pastelinked
+
+echo "Old content" > linkedfile
+
+ln linkedfile otherlink
+
+echo "a" | cb paste19
+
+assert_equals "New content" "$(cat otherlink)"
@@ -8,4 +8,19 @@ export CLIPBOARD_FORCETTY=1
 
 cb paste
 
-item_exists clipboard0-0.txt
\ No newline at end of file
+item_exists clipboard0-0.txt
+unset CLIPBOARD_FORCETTY
+
+yes "Piped text" | head -c 3000000 | cb copy20
+
+{ cb paste20; echo "$?" > status; } | head -c 10 > pasted
+
+assert_equals "Piped text" "$(cat pasted)"
+
+assert_equals "0" "$(cat status)"
+
+printf "%s" "CBZLIB01 in a file" > magicfile
+
+cb copy21 magicfile
+
+assert_equals "CBZLIB01 in a file" "$(cb paste21 | cat)"
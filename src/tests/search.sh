@@ -0,0 +1,62 @@
+#!/bin/sh
+. ./resources.sh
+start_test "Search clipboards"
+
+cb copy23 "apple"
+
+cb copy23 "banana"
+
+cb copy23 "apple pie"
+
+cb copy23 "grape"
+
+cb search23 apple > /dev/null
+
+cb copy23 "pineapple"
+
+indexed="$(cb search23 apple)"
+
+content_is_shown "$indexed" ' pie"'
+
+content_is_shown "$indexed" '"preview": "pine'
+
+assert_equals "$(printf "%s" "$indexed" | grep -c '"entry"')" "3"
+
+rm "$CLIPBOARD_TMPDIR"/Clipboard/23/metadata/search*
+
+assert_equals "$indexed" "$(cb search23 apple)"
+
+printf "%s" "needle in text" > textfile
+
+printf "needle\000in binary" > binaryfile
+
+cb copy24 textfile binaryfile
+
+contents="$(cb search24 needle --contents)"
+
+content_is_shown "$contents" 'textfile: '
+
+assert_equals "$(printf "%s" "$contents" | grep -c 'binaryfile')" "0"
+
+cb copy25 "fix the xylophone"
+
+cb copy25 "leftover box"
+
+cb copy25 "unrelated"
+
+{ head -c 2000 /dev/zero | tr '\0' 'a'; printf "\nfind the xenon\n"; } | cb copy25
+
+fuzzy="$(cb search25 ftx)"
+
+content_is_shown "$fuzzy" 'enon'
+
+assert_equals "$(printf "%s" "$fuzzy" | grep -c 'unrelated')" "0"
+
+boundaries="$(printf "%s" "$fuzzy" | grep -n 'ylophone' | cut -d: -f1)"
+
+scattered="$(printf "%s" "$fuzzy" | grep -n 'over bo' | cut -d: -f1)"
+
+if [ "$boundaries" -gt "$scattered" ]
+then
+    fail "😕 Matching the starts of words didn't rank above matching scattered letters"
+fi
@@ -25,6 +25,10 @@ export CLIPBOARD_NOAUDIO=1
 run_all_tests() {
     sh export.sh
     sh history.sh
+    sh pack-history.sh
+    sh load.sh
+    sh encoding.sh
+    sh search.sh
     sh ignore.sh
     sh add-file.sh
     sh add-pipe.sh
@@ -36,6 +40,7 @@ run_all_tests() {
     sh copy-file.sh
     sh copy-pipe.sh
     sh copy-text.sh
+    sh copy-errors.sh
     sh cut-file.sh
     sh cut-pipe.sh
     sh cut-text.sh